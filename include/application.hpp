@@ -1,26 +1,47 @@
 #ifndef APPLICATION_H
 #define APPLICATION_H
 
+#include "frame_capture.hpp"
+#include "job_system.hpp"
+#include "memory_tracker.hpp"
+#include "mesh.hpp"
+#include "particles.hpp"
+#include "resolution_controller.hpp"
+#include "scene.hpp"
+#include "specialization.hpp"
+#include "state_snapshot.hpp"
+
 #include <vulkan/vulkan.hpp>
 
 #include <GLFW/glfw3.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
 
 struct QueueFamilyIndices {
     std::optional<unsigned int> graphics_family;
     std::optional<unsigned int> present_family;
 
-    QueueFamilyIndices(const vk::PhysicalDevice &physical_device, const vk::SurfaceKHR &surface)
+    QueueFamilyIndices(const vk::PhysicalDevice &physical_device, const std::vector<vk::SurfaceKHR> &surfaces)
     {
         unsigned int i = 0;
         for (const auto &queue_family : physical_device.getQueueFamilyProperties()) {
             if (queue_family.queueFlags & vk::QueueFlagBits::eGraphics) {
                 graphics_family = i;
             }
-            if (physical_device.getSurfaceSupportKHR(i, surface)) {
+            // All windows are presented together, from a single queue
+            if (std::all_of(surfaces.cbegin(), surfaces.cend(), [&](const auto &surface) {
+                    return physical_device.getSurfaceSupportKHR(i, surface) == VK_TRUE;
+                })) {
                 present_family = i;
             }
 
@@ -67,14 +88,12 @@ struct SwapChainSupportDetails {
         return vk::PresentModeKHR::eFifo;
     }
 
-    vk::Extent2D chooseSwapExtent(GLFWwindow *window)
+    vk::Extent2D chooseSwapExtent(vk::Extent2D framebuffer_extent)
     {
         if (capabilitites.currentExtent.width != UINT32_MAX) {
             return capabilitites.currentExtent;
         } else {
-            int window_width = 0, window_height = 0;
-            glfwGetFramebufferSize(window, &window_width, &window_height);
-            vk::Extent2D actual_extent = {(uint32_t)window_width, (uint32_t)window_height};
+            vk::Extent2D actual_extent = framebuffer_extent;
 
             actual_extent.width = std::max(capabilitites.minImageExtent.width, std::min(capabilitites.maxImageExtent.width, actual_extent.width));
             actual_extent.height = std::max(capabilitites.minImageExtent.height, std::min(capabilitites.maxImageExtent.height, actual_extent.height));
@@ -84,30 +103,126 @@ struct SwapChainSupportDetails {
     }
 };
 
+// Features of scene.vert, in the order of their constant_ids
+enum class SceneFeature : uint32_t {
+    eLighting,
+    eInstanceColors,
+    eCount
+};
+using SceneVariants = SpecializationFeatures<SceneFeature>;
+// Command line and report names
+constexpr const char *scene_feature_names[] = {"lighting", "colors"};
+static_assert(std::size(scene_feature_names) == SceneVariants::feature_count, "Every scene feature needs a name");
+
+struct SceneShaderSettings {
+    // Feature mask, bit i is the feature with constant_id i
+    uint32_t features = SceneVariants::key<SceneFeature::eLighting, SceneFeature::eInstanceColors>;
+    // Branch on the features at runtime instead of using the variant specialized for them
+    bool uber_shader = false;
+    // Frames timed for every feature set, specialized and with the uber-shader, 0 disables the benchmark
+    unsigned int bench_frames = 0;
+};
+
+struct ApplicationSettings {
+    unsigned int window_count = 1;
+    CaptureSettings capture;
+    ParticleSettings particles;
+    MeshSettings mesh;
+    SceneSettings scene;
+    SceneShaderSettings scene_shader;
+    DynamicResolutionSettings dynamic_resolution;
+};
+
+// Layout of the push constants of mesh.vert
+struct MeshPushConstants {
+    float transform[16];
+};
+
+// Layout of the push constants of scene.vert
+struct ScenePushConstants {
+    float view_projection[16];
+    float mesh_scale[4];
+    float mesh_offset[4];
+    uint32_t features;
+};
+
+// Everything that is specific to one window, the device, pipelines and resources are shared
+struct WindowContext {
+    GLFWwindow *handle = nullptr;
+    std::string name;
+    vk::UniqueSurfaceKHR surface;
+
+    vk::UniqueSwapchainKHR swap_chain;
+    std::vector<vk::Image> swap_chain_images;
+    vk::Extent2D swap_chain_extent;
+    std::vector<vk::UniqueImageView> swap_chain_image_views;
+    TrackedMemory depth_image_memory;
+    vk::UniqueImage depth_image;
+    vk::UniqueImageView depth_image_view;
+    std::vector<vk::UniqueFramebuffer> swap_chain_framebuffers;
+    // One per resolution level, swap chain image and frame in flight, see commandBufferIndex().
+    // With dynamic resolution they only upscale the render target into the swap chain image.
+    std::vector<vk::CommandBuffer> command_buffers;
+
+    // Dynamic resolution: one render target per frame in flight, allocated at the swap chain extent (the largest
+    // scale) so that scale changes never reallocate, and drawn to by a command buffer per level and frame
+    std::vector<TrackedMemory> render_target_memories;
+    std::vector<vk::UniqueImage> render_targets;
+    std::vector<vk::UniqueImageView> render_target_views;
+    std::vector<vk::UniqueFramebuffer> render_target_framebuffers;
+    std::vector<vk::CommandBuffer> render_command_buffers;
+
+    std::vector<vk::UniqueSemaphore> image_available_semaphores;
+    std::vector<vk::Fence> images_in_flight;
+
+    uint64_t resize_count = 0;         // event thread
+    uint64_t handled_resize_count = 0; // render thread
+    vk::Extent2D framebuffer_extent;   // render thread
+    bool framebuffer_resized = false;  // render thread
+    bool swap_chain_outdated = false;  // render thread
+};
+
 class Application
 {
   public:
-    Application()
+    Application(const ApplicationSettings &settings = ApplicationSettings()) : settings(settings)
     {
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         // glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
-        window = glfwCreateWindow(width, height, "Vulkan Window", nullptr, nullptr);
-        glfwSetWindowUserPointer(window, this);
-        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        // The contexts are used as GLFW user pointers, the vector must not be resized after this point
+        windows.resize(std::max(settings.window_count, 1u));
+        for (size_t i = 0; i < windows.size(); i++) {
+            auto &window = windows[i];
+            window.name = windows.size() == 1 ? title : std::string(title) + " " + std::to_string(i + 1);
+            window.handle = glfwCreateWindow(width, height, window.name.c_str(), nullptr, nullptr);
+            glfwSetWindowUserPointer(window.handle, &window);
+            glfwSetFramebufferSizeCallback(window.handle, framebufferResizeCallback);
+        }
     }
 
     void run()
     {
+        for (auto &window : windows) {
+            int window_width = 0, window_height = 0;
+            glfwGetFramebufferSize(window.handle, &window_width, &window_height);
+            window.framebuffer_extent = vk::Extent2D((uint32_t)window_width, (uint32_t)window_height);
+        }
+
         initVulkan();
         mainLoop();
     }
 
     ~Application()
     {
-        glfwDestroyWindow(window);
+        if (render_thread.joinable()) {
+            stopRenderThread();
+        }
+        for (auto &window : windows) {
+            glfwDestroyWindow(window.handle);
+        }
         glfwTerminate();
     }
 
@@ -115,80 +230,233 @@ class Application
     const unsigned int width = 800;
     const unsigned int height = 600;
     const unsigned int max_frames_in_flight = 2;
-    GLFWwindow *window;
+    const char *title = "Vulkan Window";
+    const double memory_title_interval = 1.0; // seconds
+    const double memory_log_interval = 10.0;  // seconds
+    const float memory_pressure_threshold = 0.9f;
+    ApplicationSettings settings;
 
     vk::UniqueInstance instance;
     vk::DispatchLoaderDynamic dldy;
     vk::UniqueHandle<vk::DebugUtilsMessengerEXT, vk::DispatchLoaderDynamic> debug_messenger;
-    vk::UniqueSurfaceKHR surface;
 
     vk::PhysicalDevice physcial_device;
     vk::UniqueDevice device;
+    bool physical_device_properties2_enabled = false;
+    bool memory_budget_enabled = false;
+    std::unique_ptr<MemoryTracker> memory_tracker;
 
     vk::Queue graphics_queue;
     vk::Queue present_queue;
 
-    vk::UniqueSwapchainKHR swap_chain;
-    std::vector<vk::Image> swap_chain_images;
-    vk::Format swap_chain_image_format;
-    vk::Extent2D swap_chain_extent;
-    std::vector<vk::UniqueImageView> swap_chain_image_views;
-    std::vector<vk::UniqueFramebuffer> swap_chain_framebuffers;
+    vk::Format swap_chain_image_format = vk::Format::eUndefined;
+    vk::Format depth_format = vk::Format::eUndefined;
 
     vk::UniqueRenderPass render_pass;
     vk::UniquePipelineLayout pipeline_layout;
     vk::UniquePipeline graphics_pipeline;
+    vk::UniquePipeline particle_pipeline;
+    vk::UniquePipelineLayout mesh_pipeline_layout;
+    vk::UniquePipeline mesh_pipeline;
+    vk::UniquePipelineLayout scene_pipeline_layout;
+    // Indexed by SceneVariants key, only the variants in use are created
+    std::vector<vk::UniquePipeline> scene_pipelines;
+    uint32_t scene_features = 0;
+    uint32_t scene_variant = 0;
+
+    TrackedMemory mesh_vertex_buffer_memory;
+    vk::UniqueBuffer mesh_vertex_buffer;
+    TrackedMemory mesh_index_buffer_memory;
+    vk::UniqueBuffer mesh_index_buffer;
+    MeshBlobHeader mesh_header{};
+
+    std::unique_ptr<JobSystem> job_system;
+    std::unique_ptr<Scene> scene;
+    SceneBounds scene_bounds{};
+    // Persistently mapped, one per frame in flight
+    std::vector<TrackedMemory> instance_buffer_memories;
+    std::vector<vk::UniqueBuffer> instance_buffers;
+    std::vector<InstanceData *> instance_data;
+    double scene_update_time = 0.0; // milliseconds, smoothed
+
+    TrackedMemory particle_buffer_memory;
+    vk::UniqueBuffer particle_buffer;
+    vk::UniqueDescriptorSetLayout particle_descriptor_set_layout;
+    vk::UniqueDescriptorPool descriptor_pool;
+    vk::DescriptorSet particle_descriptor_set;
+    vk::UniquePipelineLayout compute_pipeline_layout;
+    vk::UniquePipeline compute_pipeline;
+    uint64_t particle_steps = 0;
 
     vk::UniqueCommandPool command_pool;
-    std::vector<vk::CommandBuffer> command_buffers;
+    vk::CommandBuffer particle_command_buffer;
+
+    // Dynamic resolution: GPU time of every frame's rendering, read back once the frame's fence signaled
+    std::unique_ptr<ResolutionController> resolution_controller;
+    vk::UniqueQueryPool timestamp_query_pool;
+    std::vector<vk::CommandBuffer> timestamp_command_buffers; // begin and end of each frame in flight
+    std::vector<bool> timestamps_written;
+    double timestamp_period = 0.0; // nanoseconds per tick
+    uint64_t timestamp_mask = 0;
+
+    // Scene shader benchmark: mean GPU time of every run so far, run 2 i times the variant specialized for the
+    // feature set i and run 2 i + 1 the uber-shader with it
+    std::vector<double> scene_shader_times;
+    unsigned int scene_shader_frames = 0;
+    double scene_shader_time = 0.0;
 
-    std::vector<vk::UniqueSemaphore> image_available_semaphores;
     std::vector<vk::UniqueSemaphore> render_finished_semaphores;
     std::vector<vk::UniqueFence> in_flight_fences;
-    std::vector<vk::Fence> images_in_flight;
     size_t current_frame = 0;
-    bool framebuffer_resized = false;
+    uint64_t frame_number = 0;
+    double last_memory_title = 0.0;
+    double last_memory_log = 0.0;
+
+    std::vector<WindowContext> windows;
+
+    // Resources of a replaced swap chain, destroyed once the frames that used them are done
+    struct RetiredSwapChain {
+        vk::UniqueSwapchainKHR swap_chain;
+        std::vector<vk::UniqueImageView> image_views;
+        TrackedMemory depth_image_memory;
+        vk::UniqueImage depth_image;
+        vk::UniqueImageView depth_image_view;
+        std::vector<vk::UniqueFramebuffer> framebuffers;
+        std::vector<vk::CommandBuffer> command_buffers;
+        std::vector<TrackedMemory> render_target_memories;
+        std::vector<vk::UniqueImage> render_targets;
+        std::vector<vk::UniqueImageView> render_target_views;
+        std::vector<vk::UniqueFramebuffer> render_target_framebuffers;
+        std::vector<vk::CommandBuffer> render_command_buffers;
+        // Still counted in the swap chain memory category
+        vk::DeviceSize image_bytes;
+        uint32_t image_count;
+        uint64_t last_frame_number;
+    };
+    std::vector<RetiredSwapChain> retired_swap_chains;
+
+    // Captures the first window
+    std::unique_ptr<FrameCapture> frame_capture;
+
+    // State published by the event (main) thread for the render thread
+    struct WindowInput {
+        vk::Extent2D framebuffer_extent;
+        uint64_t resize_count = 0;
+    };
+    struct InputSnapshot {
+        std::vector<WindowInput> windows;
+    };
+    // State published by the render thread for the event thread
+    struct RenderStatus {
+        uint64_t title_sequence = 0;
+        std::string summary;
+    };
+
+    SnapshotBuffer<InputSnapshot> input_snapshots;
+    SnapshotBuffer<RenderStatus> render_status;
+    uint64_t shown_title_sequence = 0; // event thread
+    uint64_t title_sequence = 0;       // render thread
+
+    std::thread render_thread;
+    std::atomic<bool> stop_rendering{false};
+    std::atomic<bool> rendering_done{false};
+    std::exception_ptr render_exception;
+    // Only used to put the render thread to sleep while all windows are minimized
+    std::mutex wakeup_mutex;
+    std::condition_variable wakeup_condition;
+    uint64_t input_sequence = 0;
 
     void initVulkan()
     {
         createInstance();
         setupDebugMessenger();
-        createSurface();
+        createSurfaces();
         pickPhysicalDevice();
         createLogicalDevice();
-        createSwapChain();
-        createImageViews();
+        createMemoryTracker();
+        for (auto &window : windows) {
+            createSwapChain(window);
+            createImageViews(window);
+        }
+        createResolutionController();
         createRenderPass();
         createGraphicsPipeline();
-        createFramebuffers();
         createCommandPool();
-        createCommandBuffers();
+        createTimestampQueries();
+        createParticleSystem();
+        createMesh();
+        createScene();
+        for (auto &window : windows) {
+            createDepthResources(window);
+            createRenderTargets(window);
+            createFramebuffers(window);
+            createCommandBuffers(window);
+        }
         createSyncObjects();
+        createFrameCapture();
     }
 
     void createInstance();
     void setupDebugMessenger();
-    void createSurface();
+    void createSurfaces();
     void pickPhysicalDevice();
     void createLogicalDevice();
-    void createSwapChain();
-    void createImageViews();
+    void createMemoryTracker();
+    void createSwapChain(WindowContext &window, vk::SwapchainKHR old_swap_chain = nullptr);
+    void createImageViews(WindowContext &window);
+    void createResolutionController();
     void createRenderPass();
     void createGraphicsPipeline();
-    void createFramebuffers();
+    void createDepthResources(WindowContext &window);
+    void createRenderTargets(WindowContext &window);
+    void createFramebuffers(WindowContext &window);
     void createCommandPool();
-    void createCommandBuffers();
+    void createTimestampQueries();
+    void createParticleSystem();
+    void createMesh();
+    void createScene();
+    void createCommandBuffers(WindowContext &window);
+    void recordDraws(const vk::CommandBuffer &command_buffer, const vk::Framebuffer &framebuffer, vk::Extent2D extent, size_t frame);
+    void recordUpscale(const vk::CommandBuffer &command_buffer, const vk::Image &render_target, vk::Extent2D render_extent,
+                       const vk::Image &swap_chain_image, vk::Extent2D swap_chain_extent);
+    unsigned int resolutionLevelCount() const { return resolution_controller ? resolution_controller->levelCount() : 1; }
+    size_t commandBufferIndex(const WindowContext &window, unsigned int level, uint32_t image_index, size_t frame) const
+    {
+        return (level * window.swap_chain_images.size() + image_index) * max_frames_in_flight + frame;
+    }
     void createSyncObjects();
-
+    void createFrameCapture();
+
+    void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties,
+                      MemoryCategory category, vk::UniqueBuffer &buffer, TrackedMemory &memory);
+    void copyBuffer(const vk::Buffer &src_buffer, const vk::Buffer &dst_buffer, vk::DeviceSize size, vk::DeviceSize src_offset = 0);
+    void recordParticleSimulation(const vk::CommandBuffer &command_buffer);
+    void validateParticles();
+
+    std::vector<vk::SurfaceKHR> surfaceHandles() const;
+    void updateSwapChainMemoryUsage();
+
+    void updateScene();
+    void selectSceneVariant(uint32_t features, bool uber_shader);
+    void benchmarkSceneShader(double gpu_time);
+    bool sceneShaderBenchmarkDone() const { return scene_shader_times.size() == 2 * size_t(SceneVariants::uber_key); }
+    void reportSceneShaderBenchmark();
+    void readFrameTime();
     void drawFrame();
-    void recreateSwapChain();
+    void recreateSwapChain(WindowContext &window);
+    void destroyRetiredSwapChains();
+    void reportMemory();
 
     void mainLoop();
+    void publishInput();
+    void renderLoop();
+    void waitForInput(uint64_t seen_input_sequence);
+    void stopRenderThread();
 
     static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
     {
-        auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
-        app->framebuffer_resized = true;
+        auto context = reinterpret_cast<WindowContext *>(glfwGetWindowUserPointer(window));
+        context->resize_count++;
     }
 };
 
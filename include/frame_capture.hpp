@@ -0,0 +1,99 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "memory_tracker.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat {
+    eRaw,
+    ePng
+};
+
+struct CaptureSettings {
+    bool enabled = false;
+    std::string output_directory = "capture";
+    CaptureFormat format = CaptureFormat::ePng;
+    unsigned int ring_size = 3;
+};
+
+// Copies presented images into a ring of host-visible staging buffers without stalling the render loop.
+// A slot is only handed to the writer thread once its fence has signaled, a few frames after submission;
+// when every slot is still busy the frame is dropped instead of waited for.
+class FrameCapture
+{
+  public:
+    FrameCapture(MemoryTracker &memory_tracker, const vk::UniqueDevice &device, uint32_t queue_family_index,
+                 const CaptureSettings &settings);
+    ~FrameCapture();
+
+    // (Re)allocate the staging buffers, waits for the pending captures first
+    void resize(vk::Extent2D extent, vk::Format format);
+    // Give the staging memory of every slot but one back under memory pressure, more frames get dropped from then on.
+    // Waits for the pending captures first.
+    void shrink();
+
+    // Hand finished slots to the writer and return the next free one, if any
+    std::optional<size_t> acquireSlot();
+    // Copy image (in ePresentSrcKHR layout) into slot, signal_semaphore is signaled once the copy is done
+    void submit(size_t slot, const vk::Queue &queue, const vk::Image &image, const vk::Semaphore &signal_semaphore);
+
+    // Block until every submitted frame has been written to disk
+    void flush();
+
+  private:
+    enum SlotState {
+        eFree,
+        eInFlight,
+        eWriting
+    };
+
+    struct Slot {
+        vk::UniqueBuffer buffer;
+        TrackedMemory memory;
+        void *mapped = nullptr;
+        vk::CommandBuffer command_buffer;
+        vk::UniqueFence fence;
+        uint64_t frame_index = 0;
+        std::atomic<int> state{eFree};
+    };
+
+    MemoryTracker &memory_tracker;
+    const vk::UniqueDevice &device;
+    CaptureSettings settings;
+
+    vk::UniqueCommandPool command_pool;
+    std::vector<Slot> slots;
+    // Slots in the ring, the others have no staging buffer after shrink()
+    size_t active_slots;
+    size_t next_slot = 0;
+    vk::Extent2D extent;
+    vk::Format format = vk::Format::eUndefined;
+    bool memory_coherent = true;
+
+    uint64_t frame_counter = 0;
+    uint64_t dropped_frames = 0;
+
+    std::thread writer;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    std::deque<size_t> write_queue;
+    bool stop_writer = false;
+
+    void collect();
+    void writerLoop();
+    void writeSlot(Slot &slot);
+    void destroyBuffers();
+};
+
+#endif
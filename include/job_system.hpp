@@ -0,0 +1,139 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join job scheduler: every thread owns a deque, pushes and pops its own jobs at the bottom,
+// and idle threads steal from the top of the others' (Chase-Lev).
+// parallelFor() may be called from the workers' jobs and from one other thread at a time, the workers of another
+// JobSystem count as other threads.
+class JobSystem
+{
+  public:
+    // 0 workers runs every job on the calling thread
+    explicit JobSystem(unsigned int worker_count = defaultWorkerCount());
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    static unsigned int defaultWorkerCount();
+    // Workers plus the submitting thread
+    unsigned int threadCount() const { return static_cast<unsigned int>(workers.size()) + 1; }
+
+    // Call function(begin, end) over [0, count) in ranges of a multiple of grain_size elements and
+    // return once all of them ran, the calling thread works on them in the meantime.
+    // The first exception thrown by a range is rethrown here.
+    template <typename Function>
+    void parallelFor(size_t count, size_t grain_size, const Function &function);
+
+  private:
+    // Jobs of one parallelFor() call
+    struct Batch {
+        std::atomic<size_t> remaining;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    struct Job {
+        void (*invoke)(const void *function, size_t begin, size_t end);
+        const void *function;
+        size_t begin;
+        size_t end;
+        Batch *batch;
+    };
+
+    // Fixed capacity, the owner falls back to running jobs inline when it is full
+    class Deque
+    {
+      public:
+        static constexpr int64_t capacity = 1024;
+
+        bool push(Job *job);
+        Job *pop();
+        Job *steal();
+
+      private:
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<Job *> jobs[capacity] = {};
+    };
+
+    void submit(Job *jobs, size_t job_count);
+    void execute(Job *job);
+    Job *findJob(size_t queue_index, uint32_t &random);
+    void workerLoop(size_t queue_index);
+
+    // Queue 0 belongs to the thread outside the pool
+    std::vector<std::unique_ptr<Deque>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+
+    std::atomic<int64_t> queued_jobs{0};
+    std::atomic<unsigned int> sleeping_workers{0};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+
+    // Set by the workers, so a thread only uses its own queue in the pool it belongs to
+    static thread_local const JobSystem *current_pool;
+    static thread_local size_t current_queue;
+
+    // Queue 0 for threads outside the pool
+    size_t queueIndex() const { return current_pool == this ? current_queue : 0; }
+};
+
+template <typename Function>
+void JobSystem::parallelFor(size_t count, size_t grain_size, const Function &function)
+{
+    if (count == 0) {
+        return;
+    }
+    grain_size = grain_size > 0 ? grain_size : 1;
+
+    // A few ranges per thread so stealing can even out the load, rounded to whole grains
+    size_t grains = (count + grain_size - 1) / grain_size;
+    size_t job_count = std::min(grains, static_cast<size_t>(threadCount()) * 4);
+    if (job_count <= 1) {
+        function(size_t(0), count);
+        return;
+    }
+    size_t range = (grains + job_count - 1) / job_count * grain_size;
+    job_count = (count + range - 1) / range;
+
+    Batch batch;
+    batch.remaining.store(job_count, std::memory_order_relaxed);
+    std::vector<Job> jobs(job_count);
+    for (size_t i = 0; i < job_count; i++) {
+        jobs[i].invoke = [](const void *f, size_t begin, size_t end) { (*static_cast<const Function *>(f))(begin, end); };
+        jobs[i].function = &function;
+        jobs[i].begin = i * range;
+        jobs[i].end = std::min(count, (i + 1) * range);
+        jobs[i].batch = &batch;
+    }
+    submit(jobs.data(), job_count);
+
+    // Help until every range ran, which may include other callers' jobs
+    size_t queue_index = queueIndex();
+    uint32_t random = static_cast<uint32_t>(queue_index) * 2654435761u + 1;
+    while (batch.remaining.load(std::memory_order_acquire) > 0) {
+        if (Job *job = findJob(queue_index, random)) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class MemoryCategory {
+    eSwapchain,
+    eBuffer,
+    eImage,
+    eStaging
+};
+constexpr size_t memory_category_count = 4;
+
+const char *memoryCategoryName(MemoryCategory category);
+
+struct MemoryHeapSnapshot {
+    vk::DeviceSize size = 0;
+    vk::DeviceSize budget = 0;
+    vk::DeviceSize usage = 0;
+    bool device_local = false;
+};
+
+struct MemorySnapshot {
+    std::vector<MemoryHeapSnapshot> heaps;
+    std::array<vk::DeviceSize, memory_category_count> category_bytes{};
+    std::array<uint32_t, memory_category_count> category_allocations{};
+    // False when budget and usage are estimated from the heap sizes and our own allocations
+    bool from_budget_extension = false;
+
+    // Highest usage / budget ratio over all heaps
+    float pressure() const;
+    // One line summary, short enough for a window title
+    std::string summary() const;
+    void log(std::ostream &out) const;
+};
+
+class MemoryTracker;
+
+// Device memory allocated through a MemoryTracker, released (and accounted for) on destruction
+class TrackedMemory
+{
+  public:
+    TrackedMemory() = default;
+    TrackedMemory(TrackedMemory &&other) noexcept { swap(other); }
+    TrackedMemory &operator=(TrackedMemory &&other) noexcept
+    {
+        reset();
+        swap(other);
+        return *this;
+    }
+    ~TrackedMemory() { reset(); }
+
+    vk::DeviceMemory operator*() const { return *memory; }
+    explicit operator bool() const { return bool(memory); }
+    vk::MemoryPropertyFlags propertyFlags() const { return property_flags; }
+
+    void reset();
+
+  private:
+    friend class MemoryTracker;
+
+    MemoryTracker *tracker = nullptr;
+    vk::UniqueDeviceMemory memory;
+    vk::MemoryPropertyFlags property_flags;
+    vk::DeviceSize size = 0;
+    MemoryCategory category = MemoryCategory::eBuffer;
+    uint32_t heap_index = 0;
+
+    void swap(TrackedMemory &other) noexcept;
+};
+
+// Single entry point for device memory allocations. Keeps per category and per heap counters, queries the
+// driver's budget through VK_EXT_memory_budget when it is enabled, and calls back subsystems when a heap
+// gets close to its budget so they can shed memory before the driver starts paging.
+class MemoryTracker
+{
+  public:
+    using PressureCallback = std::function<void(const MemorySnapshot &)>;
+
+    MemoryTracker(const vk::PhysicalDevice &physical_device, const vk::UniqueDevice &device,
+                  const vk::DispatchLoaderDynamic &dldy, bool budget_extension_enabled);
+
+    uint32_t findMemoryType(uint32_t type_filter, vk::MemoryPropertyFlags properties) const;
+    // Same as findMemoryType(), without throwing when there is none
+    std::optional<uint32_t> tryFindMemoryType(uint32_t type_filter, vk::MemoryPropertyFlags properties) const;
+    TrackedMemory allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties,
+                           MemoryCategory category);
+
+    // Memory owned by the driver (e.g. swap chain images), accounted for on the first device local heap
+    void setExternalUsage(MemoryCategory category, vk::DeviceSize bytes, uint32_t allocation_count);
+
+    MemorySnapshot snapshot() const;
+
+    // callback is called once each time the pressure rises above threshold
+    void addPressureCallback(float threshold, PressureCallback callback);
+    // Take a snapshot and fire the pressure callbacks, meant to be called periodically
+    MemorySnapshot update();
+
+  private:
+    friend class TrackedMemory;
+
+    struct PressureListener {
+        float threshold;
+        PressureCallback callback;
+        bool triggered = false;
+    };
+
+    vk::PhysicalDevice physical_device;
+    const vk::UniqueDevice &device;
+    const vk::DispatchLoaderDynamic &dldy;
+    bool budget_extension_enabled;
+    vk::PhysicalDeviceMemoryProperties memory_properties;
+
+    mutable std::mutex mutex;
+    std::array<vk::DeviceSize, memory_category_count> category_bytes{};
+    std::array<uint32_t, memory_category_count> category_allocations{};
+    std::array<vk::DeviceSize, memory_category_count> external_bytes{};
+    std::array<uint32_t, memory_category_count> external_allocations{};
+    std::vector<vk::DeviceSize> heap_bytes;
+    uint32_t external_heap_index = 0;
+
+    std::vector<PressureListener> pressure_listeners;
+
+    void release(MemoryCategory category, uint32_t heap_index, vk::DeviceSize size);
+};
+
+#endif
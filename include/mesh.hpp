@@ -0,0 +1,114 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+struct MeshSettings {
+    // .obj, .gltf, .glb or a mesh blob written by writeMeshBlob()
+    std::string path;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+};
+
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+};
+
+// Indexed triangle list as loaded from a source file
+struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+MeshData loadObj(const MappedFile &file, JobSystem &jobs);
+// Load built-in OBJ sources, malformed and flat shaded ones among them, and print whether each gives the expected result
+bool checkObjLoader(JobSystem &jobs);
+// Binary (.glb) or text (.gltf) glTF 2.0, every triangle primitive of the default scene merged into one mesh
+MeshData loadGltf(const std::string &path, JobSystem &jobs);
+// Pick the loader from the file extension
+MeshData loadMesh(const std::string &path, JobSystem &jobs);
+// Cube from -1 to 1 with flat normals
+MeshData createCubeMesh();
+
+// Reorder triangles for post-transform vertex cache locality (Forsyth's linear-speed algorithm)
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertex_count);
+// Reorder clusters of triangles so outward facing ones are drawn first (Sander et al., "Fast triangle reordering for
+// vertex locality and reduced overdraw"). The indices are left as they are when the reordered cache miss ratio
+// would exceed threshold times the input's.
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<MeshVertex> &vertices, float threshold = 1.05f);
+// Renumber vertices in the order the index buffer first references them
+void optimizeVertexFetch(MeshData &mesh);
+// Average number of vertex shader invocations per triangle with a FIFO cache
+float averageCacheMissRatio(const std::vector<uint32_t> &indices, size_t vertex_count, unsigned int cache_size = 16);
+
+// Vertex format of the blob, 16 bytes instead of the 32 of MeshVertex:
+//   position: R16G16B16A16_UNORM within the mesh bounds, see MeshBlobHeader
+//   normal:   R8G8B8A8_SNORM
+//   texcoord: R16G16_SFLOAT
+struct QuantizedVertex {
+    uint16_t position[4];
+    int8_t normal[4];
+    uint16_t texcoord[2];
+};
+
+// The blob is a header followed by the vertex and index data, ready to be copied into GPU buffers as is
+struct MeshBlobHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_size; // 2 or 4 bytes
+    // position = position_offset + unorm_position * position_scale
+    float position_offset[3];
+    float position_scale[3];
+    uint64_t vertex_data_offset;
+    uint64_t index_data_offset;
+};
+
+struct MeshBlobView {
+    const MeshBlobHeader *header;
+    const void *vertex_data;
+    size_t vertex_data_size;
+    const void *index_data;
+    size_t index_data_size;
+};
+
+// Vertex cache, overdraw and vertex fetch optimization, in that order
+void optimizeMesh(MeshData &mesh);
+std::vector<char> quantizeMesh(const MeshData &mesh);
+// Validate a blob and locate its sections, throws if it is malformed
+MeshBlobView viewMeshBlob(const char *data, size_t size);
+bool isMeshBlob(const char *data, size_t size);
+void writeMeshBlob(const std::string &path, const std::vector<char> &blob);
+
+// Load, optimize and quantize a source mesh into a blob, printing statistics of every step
+std::vector<char> convertMesh(const std::string &path, JobSystem &jobs);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "aligned_allocator.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct ParticleSettings {
+    unsigned int count = 0;
+    // Run this many frames, then compare the GPU state against the CPU reference and exit
+    unsigned int validation_frames = 0;
+    float dt = 1.0f / 60.0f;
+    float stiffness = 2.0f;
+};
+
+// Layout of one particle in the storage buffer (std430), also used as vertex input
+struct Particle {
+    float position[2];
+    float velocity[2];
+};
+
+// Layout of the push constants of particles.comp
+struct ParticlePushConstants {
+    float dt;
+    float stiffness;
+    uint32_t count;
+};
+
+// Deterministic initial state shared by the GPU buffer and the CPU reference
+std::vector<Particle> initialParticles(size_t count, float stiffness);
+
+// CPU reference implementation of particles.comp. Particles are stored as a structure of arrays so the
+// kernel can process 8 (AVX, when the CPU has it) or 4 (SSE) particles per instruction, and the range is
+// split across threads.
+class ParticleSystemCpu
+{
+  public:
+    // The kernels use unaligned loads and stores, the ranges start on multiples of 8 particles so that with
+    // this alignment their vectors never straddle a cache line
+    using FloatArray = std::vector<float, AlignedAllocator<float, 32>>;
+
+    explicit ParticleSystemCpu(const std::vector<Particle> &particles);
+
+    void step(float dt, float stiffness, JobSystem &jobs, bool use_simd = true);
+
+    size_t size() const { return position_x.size(); }
+    // Largest distance between a CPU and a GPU particle position
+    float maxPositionDifference(const Particle *particles, size_t count) const;
+
+  private:
+    FloatArray position_x;
+    FloatArray position_y;
+    FloatArray velocity_x;
+    FloatArray velocity_y;
+
+    void stepRange(size_t begin, size_t end, float dt, float stiffness, bool use_simd);
+};
+
+// Time the CPU reference with the scalar and SIMD kernels, on one and on all threads
+void runParticleBenchmark(size_t count, unsigned int steps);
+
+#endif
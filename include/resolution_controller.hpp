@@ -0,0 +1,50 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+struct DynamicResolutionSettings {
+    bool enabled = false;
+    double frame_budget = 1000.0 / 60.0; // milliseconds of GPU time per frame
+    float min_scale = 0.5f;
+    // Scales are quantized into levels from min_scale to 1, each has prerecorded command buffers
+    unsigned int level_count = 8;
+};
+
+// Picks the render scale from measured GPU frame times. The scale drops as soon as the smoothed time exceeds the
+// budget and only rises one level after a long run of frames well under it, so it does not oscillate around the
+// budget.
+class ResolutionController
+{
+  public:
+    explicit ResolutionController(const DynamicResolutionSettings &settings);
+
+    // Account one frame's GPU time in milliseconds, may change the level used by the next frames
+    void update(double gpu_time);
+
+    unsigned int levelCount() const { return settings.level_count; }
+    unsigned int level() const { return current_level; }
+    float levelScale(unsigned int level) const;
+    float scale() const { return levelScale(current_level); }
+    // Smoothed GPU time at the current level, 0 until measured
+    double frameTime() const { return smoothed_time; }
+
+  private:
+    // Fractions of the budget: above high the scale drops, below low it may rise, aims for target when it changes
+    static constexpr double high_threshold = 0.95;
+    static constexpr double low_threshold = 0.7;
+    static constexpr double target = 0.85;
+    static constexpr double smoothing = 0.2;
+    // Frames to skip after a change, their timings were taken at the previous scale
+    static constexpr unsigned int settle_frames = 4;
+    // Frames under the low threshold before the scale rises
+    static constexpr unsigned int raise_frames = 30;
+
+    void setLevel(unsigned int level);
+
+    DynamicResolutionSettings settings;
+    unsigned int current_level;
+    double smoothed_time = 0.0;
+    unsigned int skipped_frames = 0;
+    unsigned int headroom_frames = 0;
+};
+
+#endif
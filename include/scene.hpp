@@ -0,0 +1,87 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "aligned_allocator.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct SceneSettings {
+    // Animated node hierarchy drawn as instances of the mesh (a cube without --mesh), 0 disables it
+    unsigned int node_count = 0;
+};
+
+// Per instance vertex data: world matrix, row-major 3x4, the rows are vertex attributes
+struct InstanceData {
+    float rows[3][4];
+};
+
+struct alignas(16) Matrix3x4 {
+    float rows[3][4];
+};
+
+struct SceneBounds {
+    float center[3];
+    float radius;
+};
+
+// Node hierarchy in structure-of-arrays form, sorted by depth so that every level can be
+// updated in parallel once its parents are done
+class Scene
+{
+  public:
+    static constexpr uint32_t no_parent = UINT32_MAX;
+    // Every node spins by a fixed step per update, like the particle simulation
+    static constexpr float time_step = 1.0f / 60.0f;
+
+    // Nodes must be added level by level, a parent before its children.
+    // spin_axis must be normalized, bounds_radius is the radius of the instanced mesh around the node.
+    uint32_t addNode(uint32_t parent, const float translation[3], float scale, const float spin_axis[3], float spin_speed,
+                     float bounds_radius);
+
+    size_t size() const { return parents.size(); }
+    size_t levelCount() const { return level_offsets.size() - 1; }
+
+    // Animate, compute the world transforms and bounds, and write the world matrices into
+    // instances (typically mapped GPU memory, written with streaming stores)
+    void update(JobSystem &jobs, InstanceData *instances);
+    // Sphere around the world bounds of every node as of the last update
+    SceneBounds bounds() const;
+
+  private:
+    template <typename T>
+    using AlignedVector = std::vector<T, AlignedAllocator<T, 16>>;
+
+    void animateRange(size_t begin, size_t end);
+    void transformRange(size_t begin, size_t end, InstanceData *instances);
+
+    // Hierarchy, level i is [level_offsets[i], level_offsets[i + 1])
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> depths;
+    std::vector<size_t> level_offsets = {0};
+
+    // Local transform: translation, rotation quaternion, uniform scale, padded to a multiple of 4 nodes
+    AlignedVector<float> translation_x, translation_y, translation_z;
+    AlignedVector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+    AlignedVector<float> scales;
+    // Rotation applied by every update
+    AlignedVector<float> spin_x, spin_y, spin_z, spin_w;
+
+    AlignedVector<Matrix3x4> local_matrices;
+    AlignedVector<Matrix3x4> world_matrices;
+
+    // Bounding spheres, local ones are centered on the node
+    AlignedVector<float> local_radii;
+    AlignedVector<float> world_center_x, world_center_y, world_center_z, world_radii;
+};
+
+// Grid of clusters, each a root with 7 orbiting children with 8 orbiting children each
+Scene createDemoScene(size_t node_count, float mesh_radius);
+
+// Time the update of a node_count scene with 1 thread up to all hardware threads
+void runSceneBenchmark(size_t node_count, unsigned int updates);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SPECIALIZATION_H
+#define SPECIALIZATION_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Every feature doubles the pipelines a shader can need, keep it small
+constexpr uint32_t max_specialization_features = 4;
+
+namespace specialization_detail {
+
+template <size_t ConstantCount, size_t... Ids>
+constexpr std::array<vk::SpecializationMapEntry, ConstantCount> makeMapEntries(std::index_sequence<Ids...>)
+{
+    return {vk::SpecializationMapEntry(
+        static_cast<uint32_t>(Ids),                    // constantID
+        static_cast<uint32_t>(Ids * sizeof(VkBool32)), // offset
+        sizeof(VkBool32)                               // size
+        )...};
+}
+
+// Features of the specialized variant key, the uber-shader variant has every feature compiled in
+template <size_t FeatureCount>
+constexpr std::array<VkBool32, FeatureCount + 1> makeConstants(uint32_t key)
+{
+    constexpr uint32_t uber_key = 1u << FeatureCount;
+    std::array<VkBool32, FeatureCount + 1> constants = {};
+    for (size_t id = 0; id < FeatureCount; id++) {
+        constants[id] = key == uber_key || (key >> id & 1u) ? VK_TRUE : VK_FALSE;
+    }
+    constants[FeatureCount] = key == uber_key ? VK_TRUE : VK_FALSE;
+    return constants;
+}
+
+template <size_t FeatureCount, size_t... Keys>
+constexpr std::array<std::array<VkBool32, FeatureCount + 1>, sizeof...(Keys)> makeConstantTable(std::index_sequence<Keys...>)
+{
+    return {makeConstants<FeatureCount>(static_cast<uint32_t>(Keys))...};
+}
+
+} // namespace specialization_detail
+
+// Boolean shader features as specialization constants, so that the driver folds the branches away.
+// Feature is an enum class whose enumerators 0 to eCount - 1 are the shader's constant_ids. constant_id eCount
+// selects the uber-shader, which branches on a feature mask from push constants instead.
+// The map entries and the constants of every variant are tables built at compile time.
+template <typename Feature>
+class SpecializationFeatures
+{
+  public:
+    static constexpr uint32_t feature_count = static_cast<uint32_t>(Feature::eCount);
+    static_assert(feature_count > 0 && feature_count <= max_specialization_features,
+                  "A shader has 2^features specialized variants, too many features");
+
+    // Keys below uber_key are the feature masks of the specialized variants
+    static constexpr uint32_t uber_key = 1u << feature_count;
+    static constexpr uint32_t key_count = uber_key + 1;
+
+    template <Feature... Features>
+    static constexpr uint32_t key = (0u | ... | (1u << static_cast<uint32_t>(Features)));
+
+    static constexpr bool enabled(uint32_t features, Feature feature)
+    {
+        return (features >> static_cast<uint32_t>(feature) & 1u) != 0;
+    }
+
+    // Points into the static tables, stays valid for as long as the pipeline creation needs it
+    static vk::SpecializationInfo specializationInfo(uint32_t key)
+    {
+        return vk::SpecializationInfo(
+            constant_count,            // mapEntryCount
+            map_entries.data(),        // *mapEntries
+            sizeof(Constants),         // dataSize
+            constant_table[key].data() // *data
+        );
+    }
+
+  private:
+    static constexpr uint32_t constant_count = feature_count + 1;
+    using Constants = std::array<VkBool32, constant_count>;
+
+    static constexpr std::array<vk::SpecializationMapEntry, constant_count> map_entries =
+        specialization_detail::makeMapEntries<constant_count>(std::make_index_sequence<constant_count>());
+    static constexpr std::array<Constants, key_count> constant_table =
+        specialization_detail::makeConstantTable<feature_count>(std::make_index_sequence<key_count>());
+};
+
+#endif
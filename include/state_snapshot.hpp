@@ -0,0 +1,42 @@
+#ifndef STATE_SNAPSHOT_H
+#define STATE_SNAPSHOT_H
+
+#include <array>
+#include <atomic>
+
+// Lock-free handoff of a state snapshot from one producer thread to one consumer thread.
+// The producer fills back() and publishes it, the consumer reads the latest published snapshot.
+// Besides the front and back buffers a third, shared slot holds the last published snapshot, so that
+// neither side ever waits for the other or touches a buffer the other one is using.
+template <typename T>
+class SnapshotBuffer
+{
+  public:
+    // Producer side: the buffer to fill, it must be written completely before publish()
+    T &back() { return slots[back_index]; }
+
+    void publish()
+    {
+        back_index = shared.exchange(back_index | fresh_bit, std::memory_order_acq_rel) & index_mask;
+    }
+
+    // Consumer side: the latest published snapshot, stays valid until the next call
+    const T &read()
+    {
+        if (shared.load(std::memory_order_relaxed) & fresh_bit) {
+            front_index = shared.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+        }
+        return slots[front_index];
+    }
+
+  private:
+    static constexpr int index_mask = 0x3;
+    static constexpr int fresh_bit = 0x4;
+
+    std::array<T, 3> slots{};
+    int back_index = 0;
+    int front_index = 1;
+    std::atomic<int> shared{2};
+};
+
+#endif
@@ -0,0 +1,25 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Quantized vertex format of the mesh blob, see mesh.hpp
+layout(location = 0) in vec4 inPosition; // R16G16B16A16_UNORM, within the mesh bounds
+layout(location = 1) in vec4 inNormal;   // R8G8B8A8_SNORM
+layout(location = 2) in vec2 inTexcoord; // R16G16_SFLOAT
+
+layout(push_constant) uniform PushConstants {
+    // Dequantization and view projection in one matrix
+    mat4 transform;
+} pushConstants;
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+    gl_Position = pushConstants.transform * vec4(inPosition.xyz, 1.0);
+
+    // The view is fixed, so is the light in object space
+    vec3 light = normalize(vec3(0.4, 0.8, 0.5));
+    float diffuse = max(dot(normalize(inNormal.xyz), light), 0.0);
+    vec3 albedo = mix(vec3(0.8, 0.8, 0.75), vec3(0.6, 0.7, 0.9), fract(inTexcoord.x));
+    fragColor = albedo * (0.15 + 0.85 * diffuse);
+}
@@ -0,0 +1,15 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inVelocity;
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+    gl_PointSize = 1.0;
+    gl_Position = vec4(inPosition, 0.0, 1.0);
+    // Particles are blended additively, keep each one faint
+    fragColor = mix(vec3(0.1, 0.2, 0.8), vec3(1.0, 0.5, 0.1), clamp(length(inVelocity), 0.0, 1.0)) * 0.2;
+}
@@ -0,0 +1,54 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Quantized vertex format of the mesh blob, see mesh.hpp
+layout(location = 0) in vec4 inPosition; // R16G16B16A16_UNORM, within the mesh bounds
+layout(location = 1) in vec4 inNormal;   // R8G8B8A8_SNORM
+layout(location = 2) in vec2 inTexcoord; // R16G16_SFLOAT
+
+// World matrix of the instance, row-major 3x4, written by Scene::update()
+layout(location = 3) in vec4 inWorld0;
+layout(location = 4) in vec4 inWorld1;
+layout(location = 5) in vec4 inWorld2;
+
+// Features, see SceneFeature in application.hpp
+layout(constant_id = 0) const bool lighting = true;
+layout(constant_id = 1) const bool instanceColors = true;
+// The uber-shader reads the features from the push constants instead
+layout(constant_id = 2) const bool uberShader = false;
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+    // Dequantization into the unit sphere the scene nodes are sized for
+    vec4 meshScale;
+    vec4 meshOffset;
+    uint features; // bit i enables the feature with constant_id i, uber-shader only
+} pushConstants;
+
+layout(location = 0) out vec3 fragColor;
+
+bool enabled(bool feature, uint id)
+{
+    return uberShader ? (pushConstants.features & (1u << id)) != 0u : feature;
+}
+
+void main()
+{
+    vec4 local = vec4(inPosition.xyz * pushConstants.meshScale.xyz + pushConstants.meshOffset.xyz, 1.0);
+    vec3 world = vec3(dot(inWorld0, local), dot(inWorld1, local), dot(inWorld2, local));
+    gl_Position = pushConstants.viewProjection * vec4(world, 1.0);
+
+    vec3 albedo = vec3(0.75);
+    if (enabled(instanceColors, 1u)) {
+        albedo = 0.55 + 0.4 * cos(6.2831853 * (0.618034 * float(gl_InstanceIndex) + vec3(0.0, 0.33, 0.67)));
+    }
+
+    float shade = 1.0;
+    if (enabled(lighting, 0u)) {
+        // Scaling is uniform, the rotated normal only needs to be renormalized
+        vec3 normal = normalize(vec3(dot(inWorld0.xyz, inNormal.xyz), dot(inWorld1.xyz, inNormal.xyz), dot(inWorld2.xyz, inNormal.xyz)));
+        vec3 light = normalize(vec3(0.4, 0.8, 0.5));
+        shade = 0.15 + 0.85 * max(dot(normal, light), 0.0);
+    }
+    fragColor = albedo * shade;
+}
@@ -1,9 +1,14 @@
 #include "application.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <set>
+#include <sstream>
+#include <thread>
 
 const std::vector<const char *> validation_layers = {"VK_LAYER_KHRONOS_validation"};
 const std::vector<const char *> device_extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
@@ -26,6 +31,16 @@ std::vector<const char *> getRequiredExtensions()
     return extensions;
 }
 
+bool checkInstanceExtensionSupport(const char *extension_name)
+{
+    for (const auto &extension : vk::enumerateInstanceExtensionProperties()) {
+        if (std::string(extension.extensionName) == extension_name) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool checkValidationLayerSupport()
 {
     auto required_layers = std::set<std::string>(validation_layers.cbegin(), validation_layers.cend());
@@ -60,6 +75,12 @@ void Application::createInstance()
 
     auto extensions = getRequiredExtensions();
 
+    // Needed to query VK_EXT_memory_budget on a Vulkan 1.0 instance
+    physical_device_properties2_enabled = checkInstanceExtensionSupport(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (physical_device_properties2_enabled) {
+        extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
     auto create_info = vk::InstanceCreateInfo(
         {},                                           // flags
         &app_info,                                    // *applicationInfo
@@ -108,14 +129,25 @@ void Application::setupDebugMessenger()
     }
 }
 
-void Application::createSurface()
+void Application::createSurfaces()
+{
+    for (auto &window : windows) {
+        VkSurfaceKHR surface_tmp;
+        if (glfwCreateWindowSurface(*instance, window.handle, nullptr, &surface_tmp) != VK_SUCCESS) {
+            throw std::runtime_error("Could not create window surface!");
+        }
+        // Set the instance as the allocator for correct order of destruction
+        window.surface = vk::UniqueSurfaceKHR(surface_tmp, *instance);
+    }
+}
+
+std::vector<vk::SurfaceKHR> Application::surfaceHandles() const
 {
-    VkSurfaceKHR surface_tmp;
-    if (glfwCreateWindowSurface(*instance, window, nullptr, &surface_tmp) != VK_SUCCESS) {
-        std::runtime_error("Could not create window surface!");
+    auto surfaces = std::vector<vk::SurfaceKHR>();
+    for (const auto &window : windows) {
+        surfaces.push_back(*window.surface);
     }
-    // Set the instance as the allocator for correct order of destruction
-    surface = vk::UniqueSurfaceKHR(surface_tmp, *instance);
+    return surfaces;
 }
 
 bool checkDeviceExtensionSupport(const vk::PhysicalDevice &physical_device)
@@ -127,13 +159,25 @@ bool checkDeviceExtensionSupport(const vk::PhysicalDevice &physical_device)
     return required_extensions.empty();
 }
 
-bool isDeviceSuitable(const vk::PhysicalDevice &physical_device, const vk::SurfaceKHR &surface)
+bool checkDeviceExtensionSupport(const vk::PhysicalDevice &physical_device, const char *extension_name)
 {
-    auto indices = QueueFamilyIndices(physical_device, surface);
+    for (const auto &extension : physical_device.enumerateDeviceExtensionProperties()) {
+        if (std::string(extension.extensionName) == extension_name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isDeviceSuitable(const vk::PhysicalDevice &physical_device, const std::vector<vk::SurfaceKHR> &surfaces)
+{
+    auto indices = QueueFamilyIndices(physical_device, surfaces);
 
     if (indices.is_complete() && checkDeviceExtensionSupport(physical_device)) {
-        auto swap_chain_support = SwapChainSupportDetails(physical_device, surface);
-        return !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+        return std::all_of(surfaces.cbegin(), surfaces.cend(), [&](const auto &surface) {
+            auto swap_chain_support = SwapChainSupportDetails(physical_device, surface);
+            return !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+        });
     }
 
     return false;
@@ -142,8 +186,9 @@ bool isDeviceSuitable(const vk::PhysicalDevice &physical_device, const vk::Surfa
 void Application::pickPhysicalDevice()
 {
     auto devices = instance->enumeratePhysicalDevices();
+    auto surfaces = surfaceHandles();
     auto it = std::find_if(
-        devices.cbegin(), devices.cend(), [&](const auto &device) { return isDeviceSuitable(device, *surface); });
+        devices.cbegin(), devices.cend(), [&](const auto &device) { return isDeviceSuitable(device, surfaces); });
     if (it == devices.cend()) {
         throw std::runtime_error("Failed to find a suitable GPU!");
     }
@@ -153,7 +198,7 @@ void Application::pickPhysicalDevice()
 
 void Application::createLogicalDevice()
 {
-    auto indices = QueueFamilyIndices(physcial_device, *surface);
+    auto indices = QueueFamilyIndices(physcial_device, surfaceHandles());
 
     std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
     std::set<unsigned int> unique_queue_families = {indices.graphics_family.value(),
@@ -182,7 +227,12 @@ void Application::createLogicalDevice()
         enabled_layer_names = nullptr;
     }
 
-    auto extensions = getRequiredExtensions();
+    auto extensions = device_extensions;
+    memory_budget_enabled = physical_device_properties2_enabled &&
+                            checkDeviceExtensionSupport(physcial_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memory_budget_enabled) {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
     auto device_create_info = vk::DeviceCreateInfo(
         {},                                                   // flags
@@ -190,8 +240,8 @@ void Application::createLogicalDevice()
         queue_create_infos.data(),                            // *queueCreateInfos
         enabled_layer_count,                                  // enabledLayerCount
         enabled_layer_names,                                  // **enabledLayerNames
-        static_cast<unsigned int>(device_extensions.size()),  // enabledExtensionCount
-        device_extensions.data()                              // **enabledExtensionNames
+        static_cast<unsigned int>(extensions.size()),         // enabledExtensionCount
+        extensions.data()                                     // **enabledExtensionNames
     );
 
     device = physcial_device.createDeviceUnique(device_create_info);
@@ -200,9 +250,18 @@ void Application::createLogicalDevice()
     present_queue = device->getQueue(indices.present_family.value(), 0);
 }
 
-void Application::createSwapChain()
+void Application::createMemoryTracker()
+{
+    memory_tracker = std::make_unique<MemoryTracker>(physcial_device, device, dldy, memory_budget_enabled);
+    memory_tracker->addPressureCallback(memory_pressure_threshold, [](const MemorySnapshot &snapshot) {
+        std::cerr << "Device memory usage is close to the budget (" << int(snapshot.pressure() * 100) << "%)" << std::endl;
+        snapshot.log(std::cerr);
+    });
+}
+
+void Application::createSwapChain(WindowContext &window, vk::SwapchainKHR old_swap_chain)
 {
-    auto swap_chain_support = SwapChainSupportDetails(physcial_device, *surface);
+    auto swap_chain_support = SwapChainSupportDetails(physcial_device, *window.surface);
     auto surface_format = swap_chain_support.chooseSwapSurfaceFormat(
         vk::Format::eB8G8R8Srgb,          // requested_format
         vk::ColorSpaceKHR::eSrgbNonlinear // requested_color_space
@@ -210,14 +269,35 @@ void Application::createSwapChain()
     auto present_mode = swap_chain_support.choosePresentMode(
         vk::PresentModeKHR::eMailbox // requested_present_mode
     );
-    auto extent = swap_chain_support.chooseSwapExtent(window);
+    auto extent = swap_chain_support.chooseSwapExtent(window.framebuffer_extent);
+
+    // The render pass and pipelines are shared by all windows
+    if (swap_chain_image_format != vk::Format::eUndefined && surface_format.format != swap_chain_image_format) {
+        throw std::runtime_error("All windows must use the same swap chain image format!");
+    }
+
+    // Frame capture copies the rendered image out of the swap chain
+    auto image_usage = vk::ImageUsageFlags(vk::ImageUsageFlagBits::eColorAttachment);
+    if (settings.capture.enabled) {
+        if (!(swap_chain_support.capabilitites.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc)) {
+            throw std::runtime_error("Frame capture requested, but swap chain images cannot be used as transfer source!");
+        }
+        image_usage |= vk::ImageUsageFlagBits::eTransferSrc;
+    }
+    // Dynamic resolution upscales into the swap chain images with a blit
+    if (settings.dynamic_resolution.enabled) {
+        if (!(swap_chain_support.capabilitites.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst)) {
+            throw std::runtime_error("Dynamic resolution requested, but swap chain images cannot be used as transfer destination!");
+        }
+        image_usage |= vk::ImageUsageFlagBits::eTransferDst;
+    }
 
     unsigned int image_count = swap_chain_support.capabilitites.minImageCount + 1;
     if (swap_chain_support.capabilitites.maxImageCount > 0 && image_count > swap_chain_support.capabilitites.maxImageCount) {
         image_count = swap_chain_support.capabilitites.maxImageCount;
     }
 
-    auto indices = QueueFamilyIndices(physcial_device, *surface);
+    auto indices = QueueFamilyIndices(physcial_device, surfaceHandles());
     auto image_sharing_mode = vk::SharingMode::eExclusive;
     uint32_t queue_family_index_count = 0;
     uint32_t *queue_family_indices = nullptr;
@@ -231,13 +311,13 @@ void Application::createSwapChain()
 
     auto swap_chain_create_info = vk::SwapchainCreateInfoKHR(
         {},                                                // flags
-        *surface,                                          // surface
+        *window.surface,                                   // surface
         image_count,                                       // minImageCount
         surface_format.format,                             // imageFormat
         surface_format.colorSpace,                         // imageColorSpace
         extent,                                            // imageExtent
         1,                                                 // imageArrayLayers
-        vk::ImageUsageFlagBits::eColorAttachment,          // imageUsage
+        image_usage,                                       // imageUsage
         image_sharing_mode,                                // imageSharingMode
         queue_family_index_count,                          // queueFamilyIndexCount
         queue_family_indices,                              // *queueFamilyIndices
@@ -245,22 +325,46 @@ void Application::createSwapChain()
         vk::CompositeAlphaFlagBitsKHR::eOpaque,            // compositeAlpha
         present_mode,                                      // presentMode
         VK_TRUE,                                           // clipped
-        nullptr                                            // oldSwapChain
+        old_swap_chain                                     // oldSwapChain
     );
 
-    swap_chain = device->createSwapchainKHRUnique(swap_chain_create_info);
-    swap_chain_images = device->getSwapchainImagesKHR(*swap_chain);
+    window.swap_chain = device->createSwapchainKHRUnique(swap_chain_create_info);
+    window.swap_chain_images = device->getSwapchainImagesKHR(*window.swap_chain);
+    window.swap_chain_extent = extent;
     swap_chain_image_format = surface_format.format;
-    swap_chain_extent = extent;
+
+    updateSwapChainMemoryUsage();
 }
 
-void Application::createImageViews()
+// Swap chain images are allocated by the driver, account for them assuming 4 bytes per pixel
+static vk::DeviceSize swapChainImageBytes(size_t image_count, vk::Extent2D extent)
 {
-    swap_chain_image_views.resize(swap_chain_images.size());
-    for (size_t i = 0; i < swap_chain_images.size(); i++) {
+    return vk::DeviceSize(image_count) * extent.width * extent.height * 4;
+}
+
+void Application::updateSwapChainMemoryUsage()
+{
+    // Retired swap chains keep their images until they are destroyed
+    vk::DeviceSize bytes = 0;
+    uint32_t image_count = 0;
+    for (const auto &window : windows) {
+        bytes += swapChainImageBytes(window.swap_chain_images.size(), window.swap_chain_extent);
+        image_count += static_cast<uint32_t>(window.swap_chain_images.size());
+    }
+    for (const auto &retired : retired_swap_chains) {
+        bytes += retired.image_bytes;
+        image_count += retired.image_count;
+    }
+    memory_tracker->setExternalUsage(MemoryCategory::eSwapchain, bytes, image_count);
+}
+
+void Application::createImageViews(WindowContext &window)
+{
+    window.swap_chain_image_views.resize(window.swap_chain_images.size());
+    for (size_t i = 0; i < window.swap_chain_images.size(); i++) {
         auto image_view_create_info = vk::ImageViewCreateInfo(
             {},                      // flags
-            swap_chain_images[i],    // image
+            window.swap_chain_images[i], // image
             vk::ImageViewType::e2D,  // viewType
             swap_chain_image_format, // format
             vk::ComponentMapping(),  // components
@@ -273,12 +377,52 @@ void Application::createImageViews()
                 )                                // subresourceRange
         );
 
-        swap_chain_image_views[i] = device->createImageViewUnique(image_view_create_info);
+        window.swap_chain_image_views[i] = device->createImageViewUnique(image_view_create_info);
+    }
+}
+
+void Application::createResolutionController()
+{
+    if (!settings.dynamic_resolution.enabled) {
+        return;
+    }
+
+    // The render targets have the swap chain format and are upscaled with a linear blit
+    auto format_features = physcial_device.getFormatProperties(swap_chain_image_format).optimalTilingFeatures;
+    auto blit_features = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+                         vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    if ((format_features & blit_features) != blit_features) {
+        throw std::runtime_error("Dynamic resolution requested, but the swap chain format cannot be blitted with linear filtering!");
     }
+
+    auto indices = QueueFamilyIndices(physcial_device, surfaceHandles());
+    auto queue_family = physcial_device.getQueueFamilyProperties()[indices.graphics_family.value()];
+    if (queue_family.timestampValidBits == 0) {
+        throw std::runtime_error("Dynamic resolution requested, but the graphics queue does not support timestamps!");
+    }
+    timestamp_period = physcial_device.getProperties().limits.timestampPeriod;
+    timestamp_mask = queue_family.timestampValidBits >= 64 ? UINT64_MAX : (uint64_t(1) << queue_family.timestampValidBits) - 1;
+
+    resolution_controller = std::make_unique<ResolutionController>(settings.dynamic_resolution);
+}
+
+static vk::Format findDepthFormat(const vk::PhysicalDevice &physical_device)
+{
+    for (auto format : {vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint}) {
+        auto properties = physical_device.getFormatProperties(format);
+        if (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+            return format;
+        }
+    }
+    throw std::runtime_error("Failed to find a supported depth format!");
 }
 
 void Application::createRenderPass()
 {
+    depth_format = findDepthFormat(physcial_device);
+
+    // With dynamic resolution the render target is then blitted into the swap chain image
+    auto color_final_layout = resolution_controller ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
     auto color_attachment = vk::AttachmentDescription(
         {},                               // flags
         swap_chain_image_format,          // format
@@ -288,7 +432,19 @@ void Application::createRenderPass()
         vk::AttachmentLoadOp::eDontCare,  // stencilLoadOp
         vk::AttachmentStoreOp::eDontCare, // stencilStoreOp
         vk::ImageLayout::eUndefined,      // initialLayout
-        vk::ImageLayout::ePresentSrcKHR   // finalLayout
+        color_final_layout                // finalLayout
+    );
+
+    auto depth_attachment = vk::AttachmentDescription(
+        {},                                             // flags
+        depth_format,                                   // format
+        vk::SampleCountFlagBits::e1,                    // samples
+        vk::AttachmentLoadOp::eClear,                   // loadOp
+        vk::AttachmentStoreOp::eDontCare,               // storeOp
+        vk::AttachmentLoadOp::eDontCare,                // stencilLoadOp
+        vk::AttachmentStoreOp::eDontCare,               // stencilStoreOp
+        vk::ImageLayout::eUndefined,                    // initialLayout
+        vk::ImageLayout::eDepthStencilAttachmentOptimal // finalLayout
     );
 
     auto color_attachment_ref = vk::AttachmentReference(
@@ -296,32 +452,55 @@ void Application::createRenderPass()
         vk::ImageLayout::eColorAttachmentOptimal // layout
     );
 
+    auto depth_attachment_ref = vk::AttachmentReference(
+        1,                                              // attachment
+        vk::ImageLayout::eDepthStencilAttachmentOptimal // layout
+    );
+
     auto subpass = vk::SubpassDescription(
         {},                               // flags
         vk::PipelineBindPoint::eGraphics, // pipilineBindPoint
         0,                                // inputAttachmentCount
         nullptr,                          // *inputAttachments
         1,                                // colorAttachmentCount
-        &color_attachment_ref             // *colorAttachments
+        &color_attachment_ref,            // *colorAttachments
+        nullptr,                          // *resolveAttachments
+        &depth_attachment_ref             // *depthStencilAttachment
     );
 
-    auto subpass_dependency = vk::SubpassDependency(
-        VK_SUBPASS_EXTERNAL,                               // srcSubpass
-        0,                                                 // dstSubpass
+    // The depth buffer is shared by the frames in flight, the previous frame's depth tests must be done before it is cleared
+    auto input_dependency = vk::SubpassDependency(
+        VK_SUBPASS_EXTERNAL, // srcSubpass
+        0,                   // dstSubpass
+        vk::PipelineStageFlagBits::eColorAttachmentOutput |
+            vk::PipelineStageFlagBits::eLateFragmentTests, // srcStageMask
+        vk::PipelineStageFlagBits::eColorAttachmentOutput |
+            vk::PipelineStageFlagBits::eEarlyFragmentTests, // dstStageMask
+        vk::AccessFlagBits::eDepthStencilAttachmentWrite,   // srcAccessMask
+        vk::AccessFlagBits::eColorAttachmentWrite |
+            vk::AccessFlagBits::eDepthStencilAttachmentWrite // dstAccessMask
+    );
+
+    // The upscaling blit reads the render target after the rendering and after its transition to the final layout
+    auto output_dependency = vk::SubpassDependency(
+        0,                                                 // srcSubpass
+        VK_SUBPASS_EXTERNAL,                               // dstSubpass
         vk::PipelineStageFlagBits::eColorAttachmentOutput, // srcStageMask
-        vk::PipelineStageFlagBits::eColorAttachmentOutput, // dstStageMask
-        {},                                                // srcAccessMask
-        vk::AccessFlagBits::eColorAttachmentWrite          // dstAccessMask
+        vk::PipelineStageFlagBits::eTransfer,              // dstStageMask
+        vk::AccessFlagBits::eColorAttachmentWrite,         // srcAccessMask
+        vk::AccessFlagBits::eTransferRead                  // dstAccessMask
     );
 
+    vk::AttachmentDescription attachments[] = {color_attachment, depth_attachment};
+    vk::SubpassDependency dependencies[] = {input_dependency, output_dependency};
     auto render_pass_create_info = vk::RenderPassCreateInfo(
-        {},                 // flags
-        1,                  // attachmentCount
-        &color_attachment,  // *attachments
-        1,                  // subpassCount
-        &subpass,           // *subpasses
-        1,                  // dependencyCount
-        &subpass_dependency // *dependencies
+        {},                               // flags
+        2,                                // attachmentCount
+        attachments,                      // *attachments
+        1,                                // subpassCount
+        &subpass,                         // *subpasses
+        resolution_controller ? 2u : 1u, // dependencyCount
+        dependencies                      // *dependencies
     );
 
     render_pass = device->createRenderPassUnique(render_pass_create_info);
@@ -382,24 +561,20 @@ void Application::createGraphicsPipeline()
         VK_FALSE                              // primitiveRestartEnable
     );
 
-    auto viewport = vk::Viewport(
-        0.0f,                                        // x
-        0.0f,                                        // y
-        static_cast<float>(swap_chain_extent.width), // width
-        static_cast<float>(swap_chain_extent.height) // height
-    );
-
-    auto scissor = vk::Rect2D(
-        vk::Offset2D(0, 0), // offset
-        swap_chain_extent   // extent
+    // Viewport and scissor are dynamic so that the same pipelines serve windows of any size
+    auto viewport_state = vk::PipelineViewportStateCreateInfo(
+        {},      // flags
+        1,       // viewportCount
+        nullptr, // *viewports
+        1,       // scissorCount
+        nullptr  // *scissors
     );
 
-    auto viewport_state = vk::PipelineViewportStateCreateInfo(
-        {},        // flags
-        1,         // viewportCount
-        &viewport, // *viewports
-        1,         // scissorCount
-        &scissor   // *scissors
+    vk::DynamicState dynamic_states[] = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+    auto dynamic_state = vk::PipelineDynamicStateCreateInfo(
+        {},            // flags
+        2,             // dynamicStateCount
+        dynamic_states // *dynamicStates
     );
 
     auto rasterizer = vk::PipelineRasterizationStateCreateInfo(
@@ -422,6 +597,16 @@ void Application::createGraphicsPipeline()
         VK_FALSE                     // sampleShadingEnable
     );
 
+    // Only the mesh uses the depth buffer
+    auto depth_stencil = vk::PipelineDepthStencilStateCreateInfo(
+        {},                   // flags
+        VK_FALSE,             // depthTestEnable
+        VK_FALSE,             // depthWriteEnable
+        vk::CompareOp::eLess, // depthCompareOp
+        VK_FALSE,             // depthBoundsTestEnable
+        VK_FALSE              // stencilTestEnable
+    );
+
     auto color_blend_attachment = vk::PipelineColorBlendAttachmentState(
         VK_TRUE,                // blendEnable
         vk::BlendFactor::eOne,  // srcColorBlendFactor
@@ -464,40 +649,373 @@ void Application::createGraphicsPipeline()
         &viewport_state,    // *viewportState
         &rasterizer,        // *rasterizationState
         &multisampling,     // *multisampleState
-        nullptr,            // *depthStencilState
+        &depth_stencil,     // *depthStencilState
         &color_blending,    // *colorBlendState
-        nullptr,            // *dynamicState
+        &dynamic_state,     // *dynamicState
         *pipeline_layout,   // layout
         *render_pass        // renderPass
     );
 
     graphics_pipeline = device->createGraphicsPipelineUnique(nullptr, graphics_pipeline_create_info);
+
+    if (!settings.mesh.path.empty() || settings.scene.node_count > 0) {
+        vk::VertexInputBindingDescription mesh_binding_descriptions[] = {
+            vk::VertexInputBindingDescription(
+                0,                           // binding
+                sizeof(QuantizedVertex),     // stride
+                vk::VertexInputRate::eVertex // inputRate
+                ),
+            // Scene instances
+            vk::VertexInputBindingDescription(
+                1,                             // binding
+                sizeof(InstanceData),          // stride
+                vk::VertexInputRate::eInstance // inputRate
+                ),
+        };
+
+        vk::VertexInputAttributeDescription mesh_attribute_descriptions[] = {
+            vk::VertexInputAttributeDescription(
+                0,                                  // location
+                0,                                  // binding
+                vk::Format::eR16G16B16A16Unorm,     // format
+                offsetof(QuantizedVertex, position) // offset
+                ),
+            vk::VertexInputAttributeDescription(
+                1,                                // location
+                0,                                // binding
+                vk::Format::eR8G8B8A8Snorm,       // format
+                offsetof(QuantizedVertex, normal) // offset
+                ),
+            vk::VertexInputAttributeDescription(
+                2,                                  // location
+                0,                                  // binding
+                vk::Format::eR16G16Sfloat,          // format
+                offsetof(QuantizedVertex, texcoord) // offset
+                ),
+            vk::VertexInputAttributeDescription(
+                3,                               // location
+                1,                               // binding
+                vk::Format::eR32G32B32A32Sfloat, // format
+                offsetof(InstanceData, rows[0])  // offset
+                ),
+            vk::VertexInputAttributeDescription(
+                4,                               // location
+                1,                               // binding
+                vk::Format::eR32G32B32A32Sfloat, // format
+                offsetof(InstanceData, rows[1])  // offset
+                ),
+            vk::VertexInputAttributeDescription(
+                5,                               // location
+                1,                               // binding
+                vk::Format::eR32G32B32A32Sfloat, // format
+                offsetof(InstanceData, rows[2])  // offset
+                ),
+        };
+
+        auto mesh_vertex_input_info = vk::PipelineVertexInputStateCreateInfo(
+            {},                         // flags
+            1,                          // vertexBindingDescriptionCount
+            mesh_binding_descriptions,  // *vertexBindingDescriptions
+            3,                          // vertexAttributeDescriptionCount
+            mesh_attribute_descriptions // *vertexAttributeDesscriptions
+        );
+        auto scene_vertex_input_info = vk::PipelineVertexInputStateCreateInfo(
+            {},                         // flags
+            2,                          // vertexBindingDescriptionCount
+            mesh_binding_descriptions,  // *vertexBindingDescriptions
+            6,                          // vertexAttributeDescriptionCount
+            mesh_attribute_descriptions // *vertexAttributeDesscriptions
+        );
+
+        // Winding conventions differ between source formats, draw both sides and let the depth test sort them out
+        auto mesh_rasterizer = rasterizer;
+        mesh_rasterizer.cullMode = vk::CullModeFlagBits::eNone;
+
+        auto mesh_depth_stencil = depth_stencil;
+        mesh_depth_stencil.depthTestEnable = VK_TRUE;
+        mesh_depth_stencil.depthWriteEnable = VK_TRUE;
+
+        auto mesh_pipeline_create_info = graphics_pipeline_create_info;
+        mesh_pipeline_create_info.pVertexInputState = &mesh_vertex_input_info;
+        mesh_pipeline_create_info.pRasterizationState = &mesh_rasterizer;
+        mesh_pipeline_create_info.pDepthStencilState = &mesh_depth_stencil;
+
+        // The scene replaces the single mesh draw
+        if (settings.scene.node_count == 0) {
+            auto mesh_vert_shader_module = createShadermodule(device, "shaders/mesh_vertex.spv");
+            auto mesh_vert_shader_stage_info = vk::PipelineShaderStageCreateInfo(
+                {},                               // flags
+                vk::ShaderStageFlagBits::eVertex, // stage
+                *mesh_vert_shader_module,         // module
+                "main"                            // *name
+            );
+
+            vk::PipelineShaderStageCreateInfo mesh_shader_stages[] = {mesh_vert_shader_stage_info, frag_shader_stage_info};
+
+            auto push_constant_range = vk::PushConstantRange(
+                vk::ShaderStageFlagBits::eVertex, // stageFlags
+                0,                                // offset
+                sizeof(MeshPushConstants)         // size
+            );
+            auto mesh_pipeline_layout_info = vk::PipelineLayoutCreateInfo(
+                {},                  // flags
+                0,                   // setLayoutCount
+                nullptr,             // *setLayouts
+                1,                   // pushConstantRangeCount
+                &push_constant_range // *pushConstantRanges
+            );
+            mesh_pipeline_layout = device->createPipelineLayoutUnique(mesh_pipeline_layout_info);
+
+            mesh_pipeline_create_info.pStages = mesh_shader_stages;
+            mesh_pipeline_create_info.layout = *mesh_pipeline_layout;
+            mesh_pipeline = device->createGraphicsPipelineUnique(nullptr, mesh_pipeline_create_info);
+        } else {
+            auto scene_vert_shader_module = createShadermodule(device, "shaders/scene_vertex.spv");
+            auto scene_vert_shader_stage_info = vk::PipelineShaderStageCreateInfo(
+                {},                               // flags
+                vk::ShaderStageFlagBits::eVertex, // stage
+                *scene_vert_shader_module,        // module
+                "main"                            // *name
+            );
+
+            vk::PipelineShaderStageCreateInfo scene_shader_stages[] = {scene_vert_shader_stage_info, frag_shader_stage_info};
+
+            auto push_constant_range = vk::PushConstantRange(
+                vk::ShaderStageFlagBits::eVertex, // stageFlags
+                0,                                // offset
+                sizeof(ScenePushConstants)        // size
+            );
+            auto scene_pipeline_layout_info = vk::PipelineLayoutCreateInfo(
+                {},                  // flags
+                0,                   // setLayoutCount
+                nullptr,             // *setLayouts
+                1,                   // pushConstantRangeCount
+                &push_constant_range // *pushConstantRanges
+            );
+            scene_pipeline_layout = device->createPipelineLayoutUnique(scene_pipeline_layout_info);
+
+            auto scene_pipeline_create_info = mesh_pipeline_create_info;
+            scene_pipeline_create_info.pStages = scene_shader_stages;
+            scene_pipeline_create_info.pVertexInputState = &scene_vertex_input_info;
+            scene_pipeline_create_info.layout = *scene_pipeline_layout;
+
+            // Only the selected variant is compiled, the benchmark compiles every one of them
+            bool all_variants = settings.scene_shader.bench_frames > 0;
+            if (all_variants) {
+                selectSceneVariant(0, false);
+            } else {
+                selectSceneVariant(settings.scene_shader.features, settings.scene_shader.uber_shader);
+            }
+            scene_pipelines.resize(SceneVariants::key_count);
+            for (uint32_t key = 0; key < SceneVariants::key_count; key++) {
+                if (!all_variants && key != scene_variant) {
+                    continue;
+                }
+                auto specialization_info = SceneVariants::specializationInfo(key);
+                scene_shader_stages[0].pSpecializationInfo = &specialization_info;
+                scene_pipelines[key] = device->createGraphicsPipelineUnique(nullptr, scene_pipeline_create_info);
+            }
+        }
+    }
+
+    if (settings.particles.count == 0) {
+        return;
+    }
+
+    // Particles are read straight from the simulation's storage buffer and drawn as additive points
+    auto particle_vert_shader_module = createShadermodule(device, "shaders/particles_vertex.spv");
+    auto particle_vert_shader_stage_info = vk::PipelineShaderStageCreateInfo(
+        {},                               // flags
+        vk::ShaderStageFlagBits::eVertex, // stage
+        *particle_vert_shader_module,     // module
+        "main"                            // *name
+    );
+
+    vk::PipelineShaderStageCreateInfo particle_shader_stages[] = {particle_vert_shader_stage_info, frag_shader_stage_info};
+
+    auto particle_binding_description = vk::VertexInputBindingDescription(
+        0,                           // binding
+        sizeof(Particle),            // stride
+        vk::VertexInputRate::eVertex // inputRate
+    );
+
+    vk::VertexInputAttributeDescription particle_attribute_descriptions[] = {
+        vk::VertexInputAttributeDescription(
+            0,                           // location
+            0,                           // binding
+            vk::Format::eR32G32Sfloat,   // format
+            offsetof(Particle, position) // offset
+            ),
+        vk::VertexInputAttributeDescription(
+            1,                           // location
+            0,                           // binding
+            vk::Format::eR32G32Sfloat,   // format
+            offsetof(Particle, velocity) // offset
+            ),
+    };
+
+    auto particle_vertex_input_info = vk::PipelineVertexInputStateCreateInfo(
+        {},                             // flags
+        1,                              // vertexBindingDescriptionCount
+        &particle_binding_description,  // *vertexBindingDescriptions
+        2,                              // vertexAttributeDescriptionCount
+        particle_attribute_descriptions // *vertexAttributeDesscriptions
+    );
+
+    auto particle_input_assembly = vk::PipelineInputAssemblyStateCreateInfo(
+        {},                                // flags
+        vk::PrimitiveTopology::ePointList, // topology
+        VK_FALSE                           // primitiveRestartEnable
+    );
+
+    auto additive_blend_attachment = color_blend_attachment;
+    additive_blend_attachment.dstColorBlendFactor = vk::BlendFactor::eOne;
+    additive_blend_attachment.dstAlphaBlendFactor = vk::BlendFactor::eOne;
+
+    auto additive_blending = color_blending;
+    additive_blending.pAttachments = &additive_blend_attachment;
+
+    auto particle_pipeline_create_info = graphics_pipeline_create_info;
+    particle_pipeline_create_info.pStages = particle_shader_stages;
+    particle_pipeline_create_info.pVertexInputState = &particle_vertex_input_info;
+    particle_pipeline_create_info.pInputAssemblyState = &particle_input_assembly;
+    particle_pipeline_create_info.pColorBlendState = &additive_blending;
+
+    particle_pipeline = device->createGraphicsPipelineUnique(nullptr, particle_pipeline_create_info);
+}
+
+void Application::createDepthResources(WindowContext &window)
+{
+    auto image_create_info = vk::ImageCreateInfo(
+        {},                                               // flags
+        vk::ImageType::e2D,                               // imageType
+        depth_format,                                     // format
+        vk::Extent3D(                                     // extent
+            window.swap_chain_extent.width,               // width
+            window.swap_chain_extent.height,              // height
+            1                                             // depth
+            ),
+        1,                                                // mipLevels
+        1,                                                // arrayLayers
+        vk::SampleCountFlagBits::e1,                      // samples
+        vk::ImageTiling::eOptimal,                        // tiling
+        vk::ImageUsageFlagBits::eDepthStencilAttachment,  // usage
+        vk::SharingMode::eExclusive,                      // sharingMode
+        0,                                                // queueFamilyIndexCount
+        nullptr,                                          // *queueFamilyIndices
+        vk::ImageLayout::eUndefined                       // initialLayout
+    );
+    window.depth_image = device->createImageUnique(image_create_info);
+
+    window.depth_image_memory = memory_tracker->allocate(device->getImageMemoryRequirements(*window.depth_image),
+                                                         vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eImage);
+    device->bindImageMemory(*window.depth_image, *window.depth_image_memory, 0);
+
+    auto image_view_create_info = vk::ImageViewCreateInfo(
+        {},                                   // flags
+        *window.depth_image,                  // image
+        vk::ImageViewType::e2D,               // viewType
+        depth_format,                         // format
+        vk::ComponentMapping(),               // components
+        vk::ImageSubresourceRange(
+            vk::ImageAspectFlagBits::eDepth,  // aspectMask
+            0,                                // baseMipLevel
+            1,                                // levelCount
+            0,                                // baseArrayLayer
+            1                                 // layerCount
+            )                                 // subresourceRange
+    );
+    window.depth_image_view = device->createImageViewUnique(image_view_create_info);
 }
 
-void Application::createFramebuffers()
+void Application::createRenderTargets(WindowContext &window)
 {
-    swap_chain_framebuffers.resize(swap_chain_image_views.size());
+    if (!resolution_controller) {
+        return;
+    }
+
+    window.render_target_memories.resize(max_frames_in_flight);
+    window.render_targets.resize(max_frames_in_flight);
+    window.render_target_views.resize(max_frames_in_flight);
+    for (size_t i = 0; i < max_frames_in_flight; i++) {
+        auto image_create_info = vk::ImageCreateInfo(
+            {},                                                                              // flags
+            vk::ImageType::e2D,                                                              // imageType
+            swap_chain_image_format,                                                         // format
+            vk::Extent3D(                                                                    // extent
+                window.swap_chain_extent.width,                                              // width
+                window.swap_chain_extent.height,                                             // height
+                1                                                                            // depth
+                ),
+            1,                                                                               // mipLevels
+            1,                                                                               // arrayLayers
+            vk::SampleCountFlagBits::e1,                                                     // samples
+            vk::ImageTiling::eOptimal,                                                       // tiling
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc, // usage
+            vk::SharingMode::eExclusive,                                                     // sharingMode
+            0,                                                                               // queueFamilyIndexCount
+            nullptr,                                                                         // *queueFamilyIndices
+            vk::ImageLayout::eUndefined                                                      // initialLayout
+        );
+        window.render_targets[i] = device->createImageUnique(image_create_info);
 
-    for (size_t i = 0; i < swap_chain_image_views.size(); i++) {
-        vk::ImageView attachments[] = {*swap_chain_image_views[i]};
+        window.render_target_memories[i] = memory_tracker->allocate(device->getImageMemoryRequirements(*window.render_targets[i]),
+                                                                    vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eImage);
+        device->bindImageMemory(*window.render_targets[i], *window.render_target_memories[i], 0);
+
+        auto image_view_create_info = vk::ImageViewCreateInfo(
+            {},                          // flags
+            *window.render_targets[i],   // image
+            vk::ImageViewType::e2D,      // viewType
+            swap_chain_image_format,     // format
+            vk::ComponentMapping(),      // components
+            vk::ImageSubresourceRange(
+                vk::ImageAspectFlagBits::eColor, // aspectMask
+                0,                               // baseMipLevel
+                1,                               // levelCount
+                0,                               // baseArrayLayer
+                1                                // layerCount
+                )                                // subresourceRange
+        );
+        window.render_target_views[i] = device->createImageViewUnique(image_view_create_info);
+    }
+}
+
+void Application::createFramebuffers(WindowContext &window)
+{
+    auto createFramebuffer = [&](const vk::ImageView &color_view) {
+        vk::ImageView attachments[] = {color_view, *window.depth_image_view};
 
         auto framebuffer_create_info = vk::FramebufferCreateInfo(
-            {},                       //flags
-            *render_pass,             // renderPass
-            1,                        // attachmentCount
-            attachments,              // *attachments
-            swap_chain_extent.width,  // width
-            swap_chain_extent.height, // height
-            1                         // layers
+            {},                              //flags
+            *render_pass,                    // renderPass
+            2,                               // attachmentCount
+            attachments,                     // *attachments
+            window.swap_chain_extent.width,  // width
+            window.swap_chain_extent.height, // height
+            1                                // layers
         );
+        return device->createFramebufferUnique(framebuffer_create_info);
+    };
+
+    // With dynamic resolution the swap chain images are only blitted to
+    if (resolution_controller) {
+        window.render_target_framebuffers.resize(max_frames_in_flight);
+        for (size_t i = 0; i < max_frames_in_flight; i++) {
+            window.render_target_framebuffers[i] = createFramebuffer(*window.render_target_views[i]);
+        }
+        return;
+    }
 
-        swap_chain_framebuffers[i] = device->createFramebufferUnique(framebuffer_create_info);
+    window.swap_chain_framebuffers.resize(window.swap_chain_image_views.size());
+    for (size_t i = 0; i < window.swap_chain_image_views.size(); i++) {
+        window.swap_chain_framebuffers[i] = createFramebuffer(*window.swap_chain_image_views[i]);
     }
 }
 
 void Application::createCommandPool()
 {
-    auto indices = QueueFamilyIndices(physcial_device, *surface);
+    auto indices = QueueFamilyIndices(physcial_device, surfaceHandles());
 
     auto pool_create_info = vk::CommandPoolCreateInfo(
         {},                             // flags
@@ -506,146 +1024,1130 @@ void Application::createCommandPool()
     command_pool = device->createCommandPoolUnique(pool_create_info);
 }
 
-void Application::createCommandBuffers()
+void Application::createTimestampQueries()
 {
+    if (!resolution_controller) {
+        return;
+    }
+
+    auto query_pool_create_info = vk::QueryPoolCreateInfo(
+        {},                        // flags
+        vk::QueryType::eTimestamp, // queryType
+        2 * max_frames_in_flight   // queryCount
+    );
+    timestamp_query_pool = device->createQueryPoolUnique(query_pool_create_info);
+    timestamps_written.assign(max_frames_in_flight, false);
+
     auto alloc_info = vk::CommandBufferAllocateInfo(
-        *command_pool,                           // commandPool
-        vk::CommandBufferLevel::ePrimary,        // level
-        (uint32_t)swap_chain_framebuffers.size() // commandBufferCount
+        *command_pool,                    // commandPool
+        vk::CommandBufferLevel::ePrimary, // level
+        2 * max_frames_in_flight          // commandBufferCount
     );
+    timestamp_command_buffers = device->allocateCommandBuffers(alloc_info);
+
+    // Submitted around the rendering of each frame, the upscaling and presentation are not measured
+    for (uint32_t i = 0; i < max_frames_in_flight; i++) {
+        auto &begin_command_buffer = timestamp_command_buffers[2 * i];
+        begin_command_buffer.begin(vk::CommandBufferBeginInfo());
+        begin_command_buffer.resetQueryPool(*timestamp_query_pool, 2 * i, 2);
+        begin_command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *timestamp_query_pool, 2 * i);
+        begin_command_buffer.end();
+
+        auto &end_command_buffer = timestamp_command_buffers[2 * i + 1];
+        end_command_buffer.begin(vk::CommandBufferBeginInfo());
+        end_command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *timestamp_query_pool, 2 * i + 1);
+        end_command_buffer.end();
+    }
+}
 
-    command_buffers = device->allocateCommandBuffers(alloc_info);
+void Application::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties,
+                               MemoryCategory category, vk::UniqueBuffer &buffer, TrackedMemory &memory)
+{
+    auto buffer_create_info = vk::BufferCreateInfo(
+        {},                         // flags
+        size,                       // size
+        usage,                      // usage
+        vk::SharingMode::eExclusive // sharingMode
+    );
+    buffer = device->createBufferUnique(buffer_create_info);
 
-    auto command_buffer_begin_info = vk::CommandBufferBeginInfo(
-        vk::CommandBufferUsageFlagBits::eSimultaneousUse, // flags
-        nullptr                                           // *inheritanceInfo
+    memory = memory_tracker->allocate(device->getBufferMemoryRequirements(*buffer), properties, category);
+    device->bindBufferMemory(*buffer, *memory, 0);
+}
+
+void Application::copyBuffer(const vk::Buffer &src_buffer, const vk::Buffer &dst_buffer, vk::DeviceSize size,
+                             vk::DeviceSize src_offset)
+{
+    auto alloc_info = vk::CommandBufferAllocateInfo(
+        *command_pool,                    // commandPool
+        vk::CommandBufferLevel::ePrimary, // level
+        1                                 // commandBufferCount
     );
-    for (size_t i = 0; i < command_buffers.size(); i++) {
-        command_buffers[i].begin(command_buffer_begin_info);
+    auto command_buffers = device->allocateCommandBuffers(alloc_info);
 
-        auto clear_color = vk::ClearValue(std::array{0.0f, 0.0f, 0.0f, 1.0f});
-        auto render_pass_begin_info = vk::RenderPassBeginInfo(
-            *render_pass,                // renderPass
-            *swap_chain_framebuffers[i], // framebuffer
-            vk::Rect2D(                  // renderArea
-                {0, 0},                  // offset
-                swap_chain_extent        // extent
-                ),
-            1,           // clearValueCount
-            &clear_color // *clearValues
+    command_buffers[0].begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    command_buffers[0].copyBuffer(src_buffer, dst_buffer, vk::BufferCopy(src_offset, 0, size));
+    command_buffers[0].end();
+
+    auto submit_info = vk::SubmitInfo(
+        0,                   // waitSemaphroeCount
+        nullptr,             // *waitSemaphores
+        nullptr,             // *waitDstStageMask
+        1,                   // commandBufferCount
+        &command_buffers[0], // *commandBuffers
+        0,                   // signalSemaphoreCount
+        nullptr              // *signalSemaphores
+    );
+    graphics_queue.submit(submit_info, nullptr);
+    graphics_queue.waitIdle();
+
+    device->freeCommandBuffers(*command_pool, command_buffers);
+}
+
+void Application::createParticleSystem()
+{
+    if (settings.particles.count == 0) {
+        return;
+    }
+
+    // Upload the initial state through a staging buffer into device local memory
+    auto particles = initialParticles(settings.particles.count, settings.particles.stiffness);
+    vk::DeviceSize size = sizeof(Particle) * particles.size();
+
+    vk::UniqueBuffer staging_buffer;
+    TrackedMemory staging_buffer_memory;
+    createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+                 vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                 MemoryCategory::eStaging, staging_buffer, staging_buffer_memory);
+
+    void *data = device->mapMemory(*staging_buffer_memory, 0, size);
+    std::memcpy(data, particles.data(), size);
+    device->unmapMemory(*staging_buffer_memory);
+
+    createBuffer(size,
+                 vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer |
+                     vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+                 vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eBuffer, particle_buffer, particle_buffer_memory);
+    copyBuffer(*staging_buffer, *particle_buffer, size);
+
+    auto layout_binding = vk::DescriptorSetLayoutBinding(
+        0,                                  // binding
+        vk::DescriptorType::eStorageBuffer, // descriptorType
+        1,                                  // descriptorCount
+        vk::ShaderStageFlagBits::eCompute,  // stageFlags
+        nullptr                             // *immutableSamplers
+    );
+    auto layout_create_info = vk::DescriptorSetLayoutCreateInfo(
+        {},             // flags
+        1,              // bindingCount
+        &layout_binding // *bindings
+    );
+    particle_descriptor_set_layout = device->createDescriptorSetLayoutUnique(layout_create_info);
+
+    auto pool_size = vk::DescriptorPoolSize(
+        vk::DescriptorType::eStorageBuffer, // type
+        1                                   // descriptorCount
+    );
+    auto pool_create_info = vk::DescriptorPoolCreateInfo(
+        {},        // flags
+        1,         // maxSets
+        1,         // poolSizeCount
+        &pool_size // *poolSizes
+    );
+    descriptor_pool = device->createDescriptorPoolUnique(pool_create_info);
+
+    auto set_alloc_info = vk::DescriptorSetAllocateInfo(
+        *descriptor_pool,                 // descriptorPool
+        1,                                // descriptorSetCount
+        &*particle_descriptor_set_layout  // *setLayouts
+    );
+    particle_descriptor_set = device->allocateDescriptorSets(set_alloc_info)[0];
+
+    auto buffer_info = vk::DescriptorBufferInfo(
+        *particle_buffer, // buffer
+        0,                // offset
+        VK_WHOLE_SIZE     // range
+    );
+    auto descriptor_write = vk::WriteDescriptorSet(
+        particle_descriptor_set,            // dstSet
+        0,                                  // dstBinding
+        0,                                  // dstArrayElement
+        1,                                  // descriptorCount
+        vk::DescriptorType::eStorageBuffer, // descriptorType
+        nullptr,                            // *imageInfo
+        &buffer_info,                       // *bufferInfo
+        nullptr                             // *texelBufferView
+    );
+    device->updateDescriptorSets(descriptor_write, nullptr);
+
+    auto push_constant_range = vk::PushConstantRange(
+        vk::ShaderStageFlagBits::eCompute, // stageFlags
+        0,                                 // offset
+        sizeof(ParticlePushConstants)      // size
+    );
+    auto pipeline_layout_info = vk::PipelineLayoutCreateInfo(
+        {},                               // flags
+        1,                                // setLayoutCount
+        &*particle_descriptor_set_layout, // *setLayouts
+        1,                                // pushConstantRangeCount
+        &push_constant_range              // *pushConstantRanges
+    );
+    compute_pipeline_layout = device->createPipelineLayoutUnique(pipeline_layout_info);
+
+    auto compute_shader_module = createShadermodule(device, "shaders/particles_compute.spv");
+    auto compute_pipeline_create_info = vk::ComputePipelineCreateInfo(
+        {}, // flags
+        vk::PipelineShaderStageCreateInfo(
+            {},                                // flags
+            vk::ShaderStageFlagBits::eCompute, // stage
+            *compute_shader_module,            // module
+            "main"                             // *name
+            ),                   // stage
+        *compute_pipeline_layout // layout
+    );
+    compute_pipeline = device->createComputePipelineUnique(nullptr, compute_pipeline_create_info);
+
+    // The simulation runs once per frame, ahead of the draws of every window
+    auto alloc_info = vk::CommandBufferAllocateInfo(
+        *command_pool,                    // commandPool
+        vk::CommandBufferLevel::ePrimary, // level
+        1                                 // commandBufferCount
+    );
+    particle_command_buffer = device->allocateCommandBuffers(alloc_info)[0];
+    particle_command_buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse));
+    recordParticleSimulation(particle_command_buffer);
+    particle_command_buffer.end();
+}
+
+void Application::createMesh()
+{
+    if (settings.mesh.path.empty() && settings.scene.node_count == 0) {
+        return;
+    }
+
+    // Blobs are uploaded straight from the mapped file, anything else is converted first.
+    // Without a file the scene instances a cube.
+    auto file = std::optional<MappedFile>();
+    auto converted = std::vector<char>();
+    const char *blob_data = nullptr;
+    size_t blob_size = 0;
+    if (settings.mesh.path.empty()) {
+        converted = quantizeMesh(createCubeMesh());
+    } else {
+        file.emplace(settings.mesh.path);
+        blob_data = file->data();
+        blob_size = file->size();
+        if (!isMeshBlob(blob_data, blob_size)) {
+            // The scene update reuses the workers
+            job_system = std::make_unique<JobSystem>();
+            converted = convertMesh(settings.mesh.path, *job_system);
+        }
+    }
+    if (!converted.empty()) {
+        blob_data = converted.data();
+        blob_size = converted.size();
+    }
+    auto blob = viewMeshBlob(blob_data, blob_size);
+    if (blob.header->index_count == 0) {
+        throw std::runtime_error("Mesh '" + settings.mesh.path + "' is empty!");
+    }
+    mesh_header = *blob.header;
+
+    // One staging buffer holds both sections
+    vk::DeviceSize vertex_size = blob.vertex_data_size;
+    vk::DeviceSize index_size = blob.index_data_size;
+
+    vk::UniqueBuffer staging_buffer;
+    TrackedMemory staging_buffer_memory;
+    createBuffer(vertex_size + index_size, vk::BufferUsageFlagBits::eTransferSrc,
+                 vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                 MemoryCategory::eStaging, staging_buffer, staging_buffer_memory);
+
+    auto data = static_cast<char *>(device->mapMemory(*staging_buffer_memory, 0, vertex_size + index_size));
+    std::memcpy(data, blob.vertex_data, vertex_size);
+    std::memcpy(data + vertex_size, blob.index_data, index_size);
+    device->unmapMemory(*staging_buffer_memory);
+
+    createBuffer(vertex_size, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                 vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eBuffer, mesh_vertex_buffer, mesh_vertex_buffer_memory);
+    createBuffer(index_size, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                 vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eBuffer, mesh_index_buffer, mesh_index_buffer_memory);
+    copyBuffer(*staging_buffer, *mesh_vertex_buffer, vertex_size);
+    copyBuffer(*staging_buffer, *mesh_index_buffer, index_size, vertex_size);
+}
+
+void Application::createScene()
+{
+    if (settings.scene.node_count == 0) {
+        return;
+    }
+
+    if (!job_system) {
+        job_system = std::make_unique<JobSystem>();
+    }
+    // Nodes are sized for the mesh dequantized into the unit sphere
+    scene = std::make_unique<Scene>(createDemoScene(settings.scene.node_count, 1.0f));
+
+    // The update writes every frame's instances straight into that frame's buffer, which the GPU reads in place
+    vk::DeviceSize size = sizeof(InstanceData) * scene->size();
+    instance_buffer_memories.resize(max_frames_in_flight);
+    instance_buffers.resize(max_frames_in_flight);
+    instance_data.resize(max_frames_in_flight);
+    for (size_t i = 0; i < max_frames_in_flight; i++) {
+        createBuffer(size, vk::BufferUsageFlagBits::eVertexBuffer,
+                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                     MemoryCategory::eBuffer, instance_buffers[i], instance_buffer_memories[i]);
+        instance_data[i] = static_cast<InstanceData *>(device->mapMemory(*instance_buffer_memories[i], 0, size));
+    }
+
+    // The view is fixed, framed on the bounds after a first update
+    scene->update(*job_system, instance_data[0]);
+    scene_bounds = scene->bounds();
+    std::cout << "Scene: " << scene->size() << " nodes in " << scene->levelCount() << " levels, updated by "
+              << job_system->threadCount() << " threads" << std::endl;
+}
+
+void Application::updateScene()
+{
+    auto start = std::chrono::steady_clock::now();
+    scene->update(*job_system, instance_data[current_frame]);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    scene_update_time += 0.05 * (elapsed.count() - scene_update_time);
+}
+
+void Application::selectSceneVariant(uint32_t features, bool uber_shader)
+{
+    scene_features = features;
+    scene_variant = uber_shader ? SceneVariants::uber_key : features;
+}
+
+// Called with the GPU time of every frame, moves on to the next run once enough frames were timed
+void Application::benchmarkSceneShader(double gpu_time)
+{
+    // The first frames of a run may still pay for the switch
+    const unsigned int warmup_frames = 10;
+    if (sceneShaderBenchmarkDone()) {
+        return;
+    }
+    if (++scene_shader_frames > warmup_frames) {
+        scene_shader_time += gpu_time;
+    }
+    if (scene_shader_frames < warmup_frames + settings.scene_shader.bench_frames) {
+        return;
+    }
+
+    scene_shader_times.push_back(scene_shader_time / settings.scene_shader.bench_frames);
+    scene_shader_frames = 0;
+    scene_shader_time = 0.0;
+    if (sceneShaderBenchmarkDone()) {
+        return;
+    }
+    size_t run = scene_shader_times.size();
+    selectSceneVariant(static_cast<uint32_t>(run / 2), run % 2 == 1);
+
+    // The variant is baked into the prerecorded command buffers, rerecord them once nothing uses them anymore
+    device->waitIdle();
+    for (auto &window : windows) {
+        device->freeCommandBuffers(*command_pool, window.command_buffers);
+        if (!window.render_command_buffers.empty()) {
+            device->freeCommandBuffers(*command_pool, window.render_command_buffers);
+        }
+        createCommandBuffers(window);
+    }
+    // The queries still pending timed the previous run
+    timestamps_written.assign(max_frames_in_flight, false);
+}
+
+void Application::reportSceneShaderBenchmark()
+{
+    std::cout << "Scene shader: " << scene->size() << " instances of " << mesh_header.index_count << " indices, "
+              << settings.scene_shader.bench_frames << " frames per run, GPU time" << std::endl;
+    for (uint32_t features = 0; features < SceneVariants::uber_key; features++) {
+        std::string name;
+        for (uint32_t id = 0; id < SceneVariants::feature_count; id++) {
+            if (SceneVariants::enabled(features, static_cast<SceneFeature>(id))) {
+                name += (name.empty() ? "" : ",") + std::string(scene_feature_names[id]);
+            }
+        }
+        double specialized = scene_shader_times[2 * features];
+        double uber = scene_shader_times[2 * features + 1];
+        std::cout << "  " << std::left << std::setw(16) << (name.empty() ? "none" : name) << std::right << std::fixed
+                  << std::setprecision(3) << "specialized " << specialized << " ms, uber-shader " << uber << " ms, x"
+                  << std::setprecision(2) << uber / specialized << std::defaultfloat << std::endl;
+    }
+}
+
+// Column-major matrix fitting a sphere into clip space: rotate around its center to a fixed three-quarter view
+// and project orthographically, keeping the aspect ratio of the window
+static void viewTransform(const float center[3], float radius, vk::Extent2D extent, float transform[16])
+{
+    const float yaw = 0.6f, pitch = 0.4f;
+    float rotation[3][3] = {
+        {std::cos(yaw), 0.0f, std::sin(yaw)},
+        {std::sin(pitch) * std::sin(yaw), std::cos(pitch), -std::sin(pitch) * std::cos(yaw)},
+        {-std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw)},
+    };
+    radius = radius > 0.0f ? radius : 1.0f;
+
+    // Clip space y points down and depth goes from 0 (near) to 1 (far)
+    float aspect = float(extent.width) / float(std::max(extent.height, 1u));
+    float projection[3] = {std::min(1.0f / aspect, 1.0f) / radius, -std::min(aspect, 1.0f) / radius, -0.5f / radius};
+
+    for (int row = 0; row < 3; row++) {
+        float translation = 0.0f;
+        for (int column = 0; column < 3; column++) {
+            transform[column * 4 + row] = projection[row] * rotation[row][column];
+            translation -= projection[row] * rotation[row][column] * center[column];
+        }
+        transform[12 + row] = translation + (row == 2 ? 0.5f : 0.0f);
+    }
+    transform[3] = transform[7] = transform[11] = 0.0f;
+    transform[15] = 1.0f;
+}
+
+// Column-major matrix from quantized positions to the unit sphere around the mesh bounds
+static void dequantizeTransform(const MeshBlobHeader &header, float transform[16])
+{
+    const float *scale = header.position_scale;
+    float radius = 0.5f * std::sqrt(scale[0] * scale[0] + scale[1] * scale[1] + scale[2] * scale[2]);
+    radius = radius > 0.0f ? radius : 1.0f;
+
+    std::fill(transform, transform + 16, 0.0f);
+    for (int axis = 0; axis < 3; axis++) {
+        transform[axis * 4 + axis] = scale[axis] / radius;
+        transform[12 + axis] = -0.5f * scale[axis] / radius;
+    }
+    transform[15] = 1.0f;
+}
+
+// Maps the quantized positions of the mesh into clip space, the mesh bounds filling the view
+static MeshPushConstants meshTransform(const MeshBlobHeader &header, vk::Extent2D extent)
+{
+    const float center[3] = {0.0f, 0.0f, 0.0f};
+    float view[16], dequantize[16];
+    viewTransform(center, 1.0f, extent, view);
+    dequantizeTransform(header, dequantize);
+
+    auto push_constants = MeshPushConstants{};
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            for (int k = 0; k < 4; k++) {
+                push_constants.transform[column * 4 + row] += view[k * 4 + row] * dequantize[column * 4 + k];
+            }
+        }
+    }
+    return push_constants;
+}
+
+static ScenePushConstants sceneTransform(const MeshBlobHeader &header, const SceneBounds &bounds, vk::Extent2D extent, uint32_t features)
+{
+    auto push_constants = ScenePushConstants{};
+    viewTransform(bounds.center, bounds.radius, extent, push_constants.view_projection);
+
+    // The dequantization only scales and translates, pass its diagonal and translation
+    float dequantize[16];
+    dequantizeTransform(header, dequantize);
+    for (int axis = 0; axis < 3; axis++) {
+        push_constants.mesh_scale[axis] = dequantize[axis * 4 + axis];
+        push_constants.mesh_offset[axis] = dequantize[12 + axis];
+    }
+    push_constants.features = features;
+    return push_constants;
+}
+
+void Application::recordParticleSimulation(const vk::CommandBuffer &command_buffer)
+{
+    // The previous frame's draw and simulation step must be done with the buffer before it is updated again
+    auto before_simulation = vk::BufferMemoryBarrier(
+        vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eShaderWrite, // srcAccessMask
+        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,          // dstAccessMask
+        VK_QUEUE_FAMILY_IGNORED,                                                     // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                                                     // dstQueueFamilyIndex
+        *particle_buffer,                                                            // buffer
+        0,                                                                           // offset
+        VK_WHOLE_SIZE                                                                // size
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eComputeShader, // srcStageMask
+        vk::PipelineStageFlagBits::eComputeShader,                                          // dstStageMask
+        {},                                                                                  // dependencyFlags
+        nullptr,                                                                             // memoryBarriers
+        before_simulation,                                                                   // bufferMemoryBarriers
+        nullptr                                                                              // imageMemoryBarriers
+    );
+
+    // Fixed time step, so that the result can be replayed by the CPU reference
+    auto push_constants = ParticlePushConstants{settings.particles.dt, settings.particles.stiffness, settings.particles.count};
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *compute_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *compute_pipeline_layout, 0, particle_descriptor_set, nullptr);
+    command_buffer.pushConstants(*compute_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants);
+    command_buffer.dispatch((settings.particles.count + 255) / 256, 1, 1);
+
+    auto before_draw = vk::BufferMemoryBarrier(
+        vk::AccessFlagBits::eShaderWrite,         // srcAccessMask
+        vk::AccessFlagBits::eVertexAttributeRead, // dstAccessMask
+        VK_QUEUE_FAMILY_IGNORED,                  // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                  // dstQueueFamilyIndex
+        *particle_buffer,                         // buffer
+        0,                                        // offset
+        VK_WHOLE_SIZE                             // size
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader, // srcStageMask
+        vk::PipelineStageFlagBits::eVertexInput,   // dstStageMask
+        {},                                        // dependencyFlags
+        nullptr,                                   // memoryBarriers
+        before_draw,                               // bufferMemoryBarriers
+        nullptr                                    // imageMemoryBarriers
+    );
+}
+
+// Scales the render target extent, quantized so that every level can be prerecorded
+static vk::Extent2D scaleExtent(vk::Extent2D extent, float scale)
+{
+    return vk::Extent2D(
+        std::max(1u, static_cast<uint32_t>(std::lround(extent.width * scale))), // width
+        std::max(1u, static_cast<uint32_t>(std::lround(extent.height * scale))) // height
+    );
+}
+
+void Application::recordDraws(const vk::CommandBuffer &command_buffer, const vk::Framebuffer &framebuffer, vk::Extent2D extent,
+                              size_t frame)
+{
+    vk::ClearValue clear_values[] = {
+        vk::ClearColorValue(std::array{0.0f, 0.0f, 0.0f, 1.0f}),
+        vk::ClearDepthStencilValue(1.0f, 0),
+    };
+    auto render_pass_begin_info = vk::RenderPassBeginInfo(
+        *render_pass, // renderPass
+        framebuffer,  // framebuffer
+        vk::Rect2D(   // renderArea
+            {0, 0},   // offset
+            extent    // extent
+            ),
+        2,           // clearValueCount
+        clear_values // *clearValues
+    );
+    command_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+
+    auto viewport = vk::Viewport(
+        0.0f,                             // x
+        0.0f,                             // y
+        static_cast<float>(extent.width), // width
+        static_cast<float>(extent.height) // height
+    );
+    command_buffer.setViewport(0, viewport);
+    command_buffer.setScissor(0, vk::Rect2D({0, 0}, extent));
+
+    if (scene) {
+        auto push_constants = sceneTransform(mesh_header, scene_bounds, extent, scene_features);
+        vk::Buffer vertex_buffers[] = {*mesh_vertex_buffer, *instance_buffers[frame]};
+        vk::DeviceSize offsets[] = {0, 0};
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *scene_pipelines[scene_variant]);
+        command_buffer.pushConstants(*scene_pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(push_constants), &push_constants);
+        command_buffer.bindVertexBuffers(0, 2, vertex_buffers, offsets);
+        command_buffer.bindIndexBuffer(*mesh_index_buffer, 0, mesh_header.index_size == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+        command_buffer.drawIndexed(
+            mesh_header.index_count,              // indexCount
+            static_cast<uint32_t>(scene->size()), // instanceCount
+            0,                                    // firstIndex
+            0,                                    // vertexOffset
+            0                                     // firstInstance
+        );
+    } else if (mesh_pipeline) {
+        auto push_constants = meshTransform(mesh_header, extent);
+        vk::DeviceSize offset = 0;
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *mesh_pipeline);
+        command_buffer.pushConstants(*mesh_pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(push_constants), &push_constants);
+        command_buffer.bindVertexBuffers(0, *mesh_vertex_buffer, offset);
+        command_buffer.bindIndexBuffer(*mesh_index_buffer, 0, mesh_header.index_size == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+        command_buffer.drawIndexed(
+            mesh_header.index_count, // indexCount
+            1,                       // instanceCount
+            0,                       // firstIndex
+            0,                       // vertexOffset
+            0                        // firstInstance
         );
-        command_buffers[i].beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+    }
 
-        command_buffers[i].bindPipeline(vk::PipelineBindPoint::eGraphics, *graphics_pipeline);
-        command_buffers[i].draw(
+    if (settings.particles.count > 0) {
+        vk::DeviceSize offset = 0;
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *particle_pipeline);
+        command_buffer.bindVertexBuffers(0, *particle_buffer, offset);
+        command_buffer.draw(
+            settings.particles.count, // vertexCount
+            1,                        // instanceCount
+            0,                        // firstVertex
+            0                         // firstInstance
+        );
+    } else if (!mesh_pipeline && !scene) {
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphics_pipeline);
+        command_buffer.draw(
             3, // vertexCount
             1, //  instanceCount
             0, // firstVertex
             0  // firstInstance
         );
-        command_buffers[i].endRenderPass();
-        command_buffers[i].end();
+    }
+    command_buffer.endRenderPass();
+}
+
+void Application::recordUpscale(const vk::CommandBuffer &command_buffer, const vk::Image &render_target, vk::Extent2D render_extent,
+                                const vk::Image &swap_chain_image, vk::Extent2D swap_chain_extent)
+{
+    auto color_range = vk::ImageSubresourceRange(
+        vk::ImageAspectFlagBits::eColor, // aspectMask
+        0,                               // baseMipLevel
+        1,                               // levelCount
+        0,                               // baseArrayLayer
+        1                                // layerCount
+    );
+    // The render pass's output dependency orders the blit after the rendering into the render target. The swap chain
+    // image is overwritten entirely, its transition only has to follow the image available semaphore wait at the transfer stage.
+    auto before_blit = vk::ImageMemoryBarrier(
+        {},                                   // srcAccessMask
+        vk::AccessFlagBits::eTransferWrite,   // dstAccessMask
+        vk::ImageLayout::eUndefined,          // oldLayout
+        vk::ImageLayout::eTransferDstOptimal, // newLayout
+        VK_QUEUE_FAMILY_IGNORED,              // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,              // dstQueueFamilyIndex
+        swap_chain_image,                     // image
+        color_range                           // subresourceRange
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer, // srcStageMask
+        vk::PipelineStageFlagBits::eTransfer, // dstStageMask
+        {},                                   // dependencyFlags
+        nullptr,                              // memoryBarriers
+        nullptr,                              // bufferMemoryBarriers
+        before_blit                           // imageMemoryBarriers
+    );
+
+    auto layers = vk::ImageSubresourceLayers(
+        vk::ImageAspectFlagBits::eColor, // aspectMask
+        0,                               // mipLevel
+        0,                               // baseArrayLayer
+        1                                // layerCount
+    );
+    auto blit = vk::ImageBlit(
+        layers, // srcSubresource
+        {vk::Offset3D(0, 0, 0), vk::Offset3D(static_cast<int32_t>(render_extent.width), static_cast<int32_t>(render_extent.height), 1)}, // srcOffsets
+        layers, // dstSubresource
+        {vk::Offset3D(0, 0, 0), vk::Offset3D(static_cast<int32_t>(swap_chain_extent.width), static_cast<int32_t>(swap_chain_extent.height), 1)} // dstOffsets
+    );
+    command_buffer.blitImage(render_target, vk::ImageLayout::eTransferSrcOptimal, swap_chain_image, vk::ImageLayout::eTransferDstOptimal, blit,
+                             vk::Filter::eLinear);
+
+    auto before_present = vk::ImageMemoryBarrier(
+        vk::AccessFlagBits::eTransferWrite,   // srcAccessMask
+        {},                                   // dstAccessMask
+        vk::ImageLayout::eTransferDstOptimal, // oldLayout
+        vk::ImageLayout::ePresentSrcKHR,      // newLayout
+        VK_QUEUE_FAMILY_IGNORED,              // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,              // dstQueueFamilyIndex
+        swap_chain_image,                     // image
+        color_range                           // subresourceRange
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,     // srcStageMask
+        vk::PipelineStageFlagBits::eBottomOfPipe, // dstStageMask
+        {},                                       // dependencyFlags
+        nullptr,                                  // memoryBarriers
+        nullptr,                                  // bufferMemoryBarriers
+        before_present                            // imageMemoryBarriers
+    );
+}
+
+void Application::createCommandBuffers(WindowContext &window)
+{
+    auto command_buffer_begin_info = vk::CommandBufferBeginInfo(
+        vk::CommandBufferUsageFlagBits::eSimultaneousUse, // flags
+        nullptr                                           // *inheritanceInfo
+    );
+    unsigned int level_count = resolutionLevelCount();
+
+    // With dynamic resolution the scene is drawn once per frame into a render target at the level's scale,
+    // the frame in flight selects both the render target and the scene's instance buffer
+    if (resolution_controller) {
+        auto render_alloc_info = vk::CommandBufferAllocateInfo(
+            *command_pool,                     // commandPool
+            vk::CommandBufferLevel::ePrimary,  // level
+            level_count * max_frames_in_flight // commandBufferCount
+        );
+        window.render_command_buffers = device->allocateCommandBuffers(render_alloc_info);
+
+        for (unsigned int level = 0; level < level_count; level++) {
+            auto extent = scaleExtent(window.swap_chain_extent, resolution_controller->levelScale(level));
+            for (size_t frame = 0; frame < max_frames_in_flight; frame++) {
+                auto &command_buffer = window.render_command_buffers[level * max_frames_in_flight + frame];
+                command_buffer.begin(command_buffer_begin_info);
+                recordDraws(command_buffer, *window.render_target_framebuffers[frame], extent, frame);
+                command_buffer.end();
+            }
+        }
+    }
+
+    auto alloc_info = vk::CommandBufferAllocateInfo(
+        *command_pool,                                                                   // commandPool
+        vk::CommandBufferLevel::ePrimary,                                                // level
+        (uint32_t)(level_count * window.swap_chain_images.size() * max_frames_in_flight) // commandBufferCount
+    );
+    window.command_buffers = device->allocateCommandBuffers(alloc_info);
+
+    for (unsigned int level = 0; level < level_count; level++) {
+        for (uint32_t i = 0; i < window.swap_chain_images.size(); i++) {
+            for (size_t frame = 0; frame < max_frames_in_flight; frame++) {
+                auto &command_buffer = window.command_buffers[commandBufferIndex(window, level, i, frame)];
+                command_buffer.begin(command_buffer_begin_info);
+                if (resolution_controller) {
+                    auto render_extent = scaleExtent(window.swap_chain_extent, resolution_controller->levelScale(level));
+                    recordUpscale(command_buffer, *window.render_targets[frame], render_extent, window.swap_chain_images[i],
+                                  window.swap_chain_extent);
+                } else {
+                    recordDraws(command_buffer, *window.swap_chain_framebuffers[i], window.swap_chain_extent, frame);
+                }
+                command_buffer.end();
+            }
+        }
     }
 }
 
 void Application::createSyncObjects()
 {
-    image_available_semaphores.resize(max_frames_in_flight);
     render_finished_semaphores.resize(max_frames_in_flight);
     in_flight_fences.resize(max_frames_in_flight);
-    images_in_flight.resize(swap_chain_images.size());
 
     for (size_t i = 0; i < max_frames_in_flight; i++) {
-        image_available_semaphores[i] = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
         render_finished_semaphores[i] = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
         in_flight_fences[i] = device->createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
     }
+
+    for (auto &window : windows) {
+        window.image_available_semaphores.resize(max_frames_in_flight);
+        for (size_t i = 0; i < max_frames_in_flight; i++) {
+            window.image_available_semaphores[i] = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+        }
+        window.images_in_flight.resize(window.swap_chain_images.size());
+    }
+}
+
+void Application::createFrameCapture()
+{
+    if (!settings.capture.enabled) {
+        return;
+    }
+
+    auto indices = QueueFamilyIndices(physcial_device, surfaceHandles());
+    frame_capture = std::make_unique<FrameCapture>(*memory_tracker, device, indices.graphics_family.value(), settings.capture);
+    frame_capture->resize(windows[0].swap_chain_extent, swap_chain_image_format);
+
+    // The capture's staging buffers are the first memory given up when a heap gets close to its budget
+    memory_tracker->addPressureCallback(memory_pressure_threshold, [this](const MemorySnapshot &) { frame_capture->shrink(); });
+}
+
+void Application::readFrameTime()
+{
+    // The queries of this frame slot are complete once its fence has signaled
+    if (!timestamps_written[current_frame]) {
+        return;
+    }
+    timestamps_written[current_frame] = false;
+
+    uint64_t timestamps[2];
+    auto result = device->getQueryPoolResults(*timestamp_query_pool, 2 * static_cast<uint32_t>(current_frame), 2, sizeof(timestamps), timestamps,
+                                              sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess) {
+        return;
+    }
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & timestamp_mask;
+    double gpu_time = static_cast<double>(ticks) * timestamp_period * 1e-6;
+    resolution_controller->update(gpu_time);
+    if (settings.scene_shader.bench_frames > 0) {
+        benchmarkSceneShader(gpu_time);
+    }
 }
 
 void Application::drawFrame()
 {
     device->waitForFences(*in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+    destroyRetiredSwapChains();
+    if (resolution_controller) {
+        readFrameTime();
+    }
+
+    // Acquire an image from every window that can be drawn to, the others sit this frame out
+    std::vector<WindowContext *> frame_windows;
+    std::vector<uint32_t> image_indices;
+    for (auto &window : windows) {
+        if (window.swap_chain_outdated) {
+            recreateSwapChain(window);
+        }
+        if (window.swap_chain_outdated) {
+            continue;
+        }
 
-    uint32_t image_index;
-    auto result = device->acquireNextImageKHR(*swap_chain, UINT64_MAX, *image_available_semaphores[current_frame], nullptr, &image_index);
-    if (result == vk::Result::eErrorOutOfDateKHR) {
-        recreateSwapChain();
+        uint32_t image_index;
+        auto result = device->acquireNextImageKHR(*window.swap_chain, UINT64_MAX, *window.image_available_semaphores[current_frame], nullptr, &image_index);
+        if (result == vk::Result::eErrorOutOfDateKHR) {
+            recreateSwapChain(window);
+            continue;
+        }
+        if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
+            throw std::runtime_error("Failed to acquire swap chain image!");
+        }
+
+        // Check if a previous frame is using this image
+        if (window.images_in_flight[image_index] != vk::Fence(nullptr)) {
+            device->waitForFences(window.images_in_flight[image_index], VK_TRUE, UINT64_MAX);
+        }
+        // Mark the image as now being used by this frame
+        window.images_in_flight[image_index] = *in_flight_fences[current_frame];
+
+        frame_windows.push_back(&window);
+        image_indices.push_back(image_index);
+    }
+    if (frame_windows.empty()) {
         return;
     }
-    if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
-        throw std::runtime_error("Failed to acquire swap chain image!");
+    if (scene) {
+        updateScene();
     }
 
-    // Check if a previous frame is using this image
-    if (images_in_flight[image_index] != vk::Fence(nullptr)) {
-        device->waitForFences(images_in_flight[image_index], VK_TRUE, UINT64_MAX);
+    std::vector<vk::Semaphore> wait_semaphores;
+    std::vector<vk::PipelineStageFlags> wait_stages;
+    std::vector<vk::CommandBuffer> frame_command_buffers;
+    std::vector<vk::SwapchainKHR> frame_swap_chains;
+    unsigned int level = resolution_controller ? resolution_controller->level() : 0;
+    if (resolution_controller) {
+        frame_command_buffers.push_back(timestamp_command_buffers[2 * current_frame]);
+    }
+    if (settings.particles.count > 0) {
+        frame_command_buffers.push_back(particle_command_buffer);
+    }
+    // With dynamic resolution only the upscaling waits for the swap chain images, so the measured time
+    // covers the rendering of every window but not the wait for presentation
+    if (resolution_controller) {
+        for (auto *window : frame_windows) {
+            frame_command_buffers.push_back(window->render_command_buffers[level * max_frames_in_flight + current_frame]);
+        }
+        frame_command_buffers.push_back(timestamp_command_buffers[2 * current_frame + 1]);
+    }
+    auto wait_stage = resolution_controller ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    for (size_t i = 0; i < frame_windows.size(); i++) {
+        wait_semaphores.push_back(*frame_windows[i]->image_available_semaphores[current_frame]);
+        wait_stages.push_back(wait_stage);
+        frame_command_buffers.push_back(frame_windows[i]->command_buffers[commandBufferIndex(*frame_windows[i], level, image_indices[i], current_frame)]);
+        frame_swap_chains.push_back(*frame_windows[i]->swap_chain);
     }
-    // Mark the image as now being used by this frame
-    images_in_flight[image_index] = *in_flight_fences[current_frame];
-
-    vk::Semaphore wait_semaphores[] = {*image_available_semaphores[current_frame]};
-    vk::PipelineStageFlags wait_stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
     vk::Semaphore signal_semaphores[] = {*render_finished_semaphores[current_frame]};
+
+    // When capturing, the copy submission signals the render finished semaphore so presentation waits for it
+    bool capture_window = frame_windows[0] == &windows[0];
+    auto capture_slot = frame_capture && capture_window ? frame_capture->acquireSlot() : std::nullopt;
+
     auto submit_info = vk::SubmitInfo(
-        1,                             // waitSemaphroeCount
-        wait_semaphores,               // *waitSemaphores
-        &wait_stages,                  // *waitDstStageMask
-        1,                             // commandBufferCount
-        &command_buffers[image_index], // *commandBuffers
-        1,                             // signalSemaphoreCount
-        signal_semaphores              // *signalSemaphores
+        static_cast<uint32_t>(wait_semaphores.size()),       // waitSemaphroeCount
+        wait_semaphores.data(),                              // *waitSemaphores
+        wait_stages.data(),                                  // *waitDstStageMask
+        static_cast<uint32_t>(frame_command_buffers.size()), // commandBufferCount
+        frame_command_buffers.data(),                        // *commandBuffers
+        capture_slot ? 0u : 1u,                              // signalSemaphoreCount
+        signal_semaphores                                    // *signalSemaphores
     );
 
     device->resetFences(*in_flight_fences[current_frame]);
     graphics_queue.submit(submit_info, *in_flight_fences[current_frame]);
+    particle_steps++;
+    if (resolution_controller) {
+        timestamps_written[current_frame] = true;
+    }
+
+    if (capture_slot) {
+        frame_capture->submit(*capture_slot, graphics_queue, windows[0].swap_chain_images[image_indices[0]], signal_semaphores[0]);
+    }
 
+    // Present every window with a single call
+    std::vector<vk::Result> results(frame_windows.size());
     auto present_info = vk::PresentInfoKHR(
-        1,                 // waitSemaphoreCount
-        signal_semaphores, // *waitSemaphores
-        1,                 // swapchainCount
-        &*swap_chain,      // *swapchains
-        &image_index,      // *imageIndices
-        nullptr            // *results
-    );
-
-    result = present_queue.presentKHR(&present_info);
-    if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR || framebuffer_resized) {
-        framebuffer_resized = false;
-        recreateSwapChain();
-    } else if (result != vk::Result::eSuccess) {
+        1,                                                 // waitSemaphoreCount
+        signal_semaphores,                                 // *waitSemaphores
+        static_cast<uint32_t>(frame_swap_chains.size()),   // swapchainCount
+        frame_swap_chains.data(),                          // *swapchains
+        image_indices.data(),                              // *imageIndices
+        results.data()                                     // *results
+    );
+
+    auto result = present_queue.presentKHR(&present_info);
+    if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR && result != vk::Result::eErrorOutOfDateKHR) {
         throw std::runtime_error("Failed to present swap chain image!");
     }
+
+    frame_number++;
     current_frame = (current_frame + 1) % max_frames_in_flight;
+
+    for (size_t i = 0; i < frame_windows.size(); i++) {
+        auto &window = *frame_windows[i];
+        if (results[i] == vk::Result::eErrorOutOfDateKHR || results[i] == vk::Result::eSuboptimalKHR || window.framebuffer_resized) {
+            window.framebuffer_resized = false;
+            recreateSwapChain(window);
+        } else if (results[i] != vk::Result::eSuccess) {
+            throw std::runtime_error("Failed to present swap chain image!");
+        }
+    }
 }
 
-void Application::recreateSwapChain()
+void Application::recreateSwapChain(WindowContext &window)
 {
-    int window_width = 0, window_height = 0;
-    glfwGetFramebufferSize(window, &window_width, &window_height);
-    while (window_width == 0 || window_height == 0) {
-        glfwGetFramebufferSize(window, &window_width, &window_height);
-        glfwWaitEvents();
+    // A minimized window has no valid swap chain extent, it is retried once the window is restored
+    if (window.framebuffer_extent.width == 0 || window.framebuffer_extent.height == 0) {
+        window.swap_chain_outdated = true;
+        return;
+    }
+    window.swap_chain_outdated = false;
+
+    // Frames still in flight may use the old swap chain. Instead of waiting for the device to be idle, which would
+    // stall every other window, its resources are kept alive until those frames are done.
+    auto retired = RetiredSwapChain();
+    retired.image_views = std::move(window.swap_chain_image_views);
+    retired.depth_image_memory = std::move(window.depth_image_memory);
+    retired.depth_image = std::move(window.depth_image);
+    retired.depth_image_view = std::move(window.depth_image_view);
+    retired.framebuffers = std::move(window.swap_chain_framebuffers);
+    retired.command_buffers = std::move(window.command_buffers);
+    retired.render_target_memories = std::move(window.render_target_memories);
+    retired.render_targets = std::move(window.render_targets);
+    retired.render_target_views = std::move(window.render_target_views);
+    retired.render_target_framebuffers = std::move(window.render_target_framebuffers);
+    retired.render_command_buffers = std::move(window.render_command_buffers);
+    retired.swap_chain = std::move(window.swap_chain);
+    retired.image_bytes = swapChainImageBytes(window.swap_chain_images.size(), window.swap_chain_extent);
+    retired.image_count = static_cast<uint32_t>(window.swap_chain_images.size());
+    retired.last_frame_number = frame_number;
+    retired_swap_chains.push_back(std::move(retired));
+
+    createSwapChain(window, *retired_swap_chains.back().swap_chain);
+    createImageViews(window);
+    createDepthResources(window);
+    createRenderTargets(window);
+    createFramebuffers(window);
+    createCommandBuffers(window);
+    window.images_in_flight.assign(window.swap_chain_images.size(), nullptr);
+
+    if (frame_capture && &window == &windows[0]) {
+        frame_capture->resize(window.swap_chain_extent, swap_chain_image_format);
     }
+}
 
-    device->waitIdle();
-    device->freeCommandBuffers(*command_pool, command_buffers);
+void Application::destroyRetiredSwapChains()
+{
+    // Frames up to frame_number - max_frames_in_flight are complete once the current frame's fence has signaled
+    auto it = std::remove_if(retired_swap_chains.begin(), retired_swap_chains.end(), [&](auto &retired) {
+        if (retired.last_frame_number + max_frames_in_flight > frame_number) {
+            return false;
+        }
+        device->freeCommandBuffers(*command_pool, retired.command_buffers);
+        if (!retired.render_command_buffers.empty()) {
+            device->freeCommandBuffers(*command_pool, retired.render_command_buffers);
+        }
+        return true;
+    });
+    if (it != retired_swap_chains.end()) {
+        retired_swap_chains.erase(it, retired_swap_chains.end());
+        updateSwapChainMemoryUsage();
+    }
+}
+
+void Application::reportMemory()
+{
+    auto now = glfwGetTime();
+    if (now - last_memory_title < memory_title_interval) {
+        return;
+    }
+    last_memory_title = now;
+
+    auto snapshot = memory_tracker->update();
+
+    // The window title can only be changed from the event thread
+    auto &status = render_status.back();
+    status.title_sequence = ++title_sequence;
+    status.summary = snapshot.summary();
+    if (scene) {
+        std::ostringstream scene_summary;
+        scene_summary << " | scene " << std::fixed << std::setprecision(2) << scene_update_time << " ms";
+        status.summary += scene_summary.str();
+    }
+    if (resolution_controller) {
+        std::ostringstream resolution_summary;
+        resolution_summary << " | render scale " << std::lround(resolution_controller->scale() * 100.0f) << "%, GPU " << std::fixed
+                           << std::setprecision(2) << resolution_controller->frameTime() << " ms";
+        status.summary += resolution_summary.str();
+    }
+    render_status.publish();
+    glfwPostEmptyEvent();
+
+    if (now - last_memory_log >= memory_log_interval) {
+        last_memory_log = now;
+        snapshot.log(std::cout);
+    }
+}
+
+void Application::publishInput()
+{
+    auto &input = input_snapshots.back();
+    input.windows.resize(windows.size());
+    for (size_t i = 0; i < windows.size(); i++) {
+        int window_width = 0, window_height = 0;
+        glfwGetFramebufferSize(windows[i].handle, &window_width, &window_height);
+
+        input.windows[i].framebuffer_extent = vk::Extent2D((uint32_t)window_width, (uint32_t)window_height);
+        input.windows[i].resize_count = windows[i].resize_count;
+    }
+    input_snapshots.publish();
+
+    {
+        std::lock_guard<std::mutex> lock(wakeup_mutex);
+        input_sequence++;
+    }
+    wakeup_condition.notify_one();
+}
+
+void Application::waitForInput(uint64_t seen_input_sequence)
+{
+    std::unique_lock<std::mutex> lock(wakeup_mutex);
+    wakeup_condition.wait(lock, [&] { return stop_rendering || input_sequence != seen_input_sequence; });
+}
+
+void Application::renderLoop()
+{
+    try {
+        while (!stop_rendering) {
+            uint64_t seen_input_sequence;
+            {
+                std::lock_guard<std::mutex> lock(wakeup_mutex);
+                seen_input_sequence = input_sequence;
+            }
+
+            const auto &input = input_snapshots.read();
+            bool all_minimized = true;
+            for (size_t i = 0; i < windows.size(); i++) {
+                auto &window = windows[i];
+                window.framebuffer_extent = input.windows[i].framebuffer_extent;
+                if (input.windows[i].resize_count != window.handled_resize_count) {
+                    window.handled_resize_count = input.windows[i].resize_count;
+                    window.framebuffer_resized = true;
+                }
+                if (window.framebuffer_extent.width != 0 && window.framebuffer_extent.height != 0) {
+                    all_minimized = false;
+                }
+            }
+
+            // All windows minimized: sleep until the event thread publishes a new state
+            if (all_minimized) {
+                waitForInput(seen_input_sequence);
+                continue;
+            }
+
+            drawFrame();
+            reportMemory();
+
+            if (settings.particles.validation_frames > 0 && particle_steps >= settings.particles.validation_frames) {
+                break;
+            }
+            if (settings.scene_shader.bench_frames > 0 && sceneShaderBenchmarkDone()) {
+                break;
+            }
+        }
+        device->waitIdle();
 
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
-    createFramebuffers();
-    createCommandBuffers();
+        if (settings.scene_shader.bench_frames > 0 && sceneShaderBenchmarkDone()) {
+            reportSceneShaderBenchmark();
+        }
+
+        if (settings.particles.count > 0 && settings.particles.validation_frames > 0) {
+            validateParticles();
+        }
+    } catch (...) {
+        render_exception = std::current_exception();
+    }
+
+    rendering_done = true;
+    glfwPostEmptyEvent();
+}
+
+void Application::stopRenderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeup_mutex);
+        stop_rendering = true;
+    }
+    wakeup_condition.notify_one();
+    render_thread.join();
 }
 
 void Application::mainLoop()
 {
-    while (!glfwWindowShouldClose(window)) {
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-            glfwSetWindowShouldClose(window, 1);
+    // The event thread only handles GLFW events, rendering and presentation happen on the render thread
+    publishInput();
+    render_thread = std::thread(&Application::renderLoop, this);
+
+    // Closing any of the windows ends the application
+    auto should_close = [&] {
+        return std::any_of(windows.cbegin(), windows.cend(), [](const auto &window) {
+            return glfwWindowShouldClose(window.handle);
+        });
+    };
+
+    while (!should_close() && !rendering_done) {
+        glfwWaitEvents();
+        for (auto &window : windows) {
+            if (glfwGetKey(window.handle, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+                glfwSetWindowShouldClose(window.handle, 1);
+            }
+        }
+        publishInput();
+
+        const auto &status = render_status.read();
+        if (status.title_sequence != shown_title_sequence) {
+            shown_title_sequence = status.title_sequence;
+            for (const auto &window : windows) {
+                auto window_title = window.name + " - " + status.summary;
+                glfwSetWindowTitle(window.handle, window_title.c_str());
+            }
         }
-        glfwPollEvents();
-        drawFrame();
     }
-    device->waitIdle();
+
+    stopRenderThread();
+    if (render_exception) {
+        std::rethrow_exception(render_exception);
+    }
+}
+
+void Application::validateParticles()
+{
+    vk::DeviceSize size = sizeof(Particle) * settings.particles.count;
+
+    vk::UniqueBuffer readback_buffer;
+    TrackedMemory readback_buffer_memory;
+    createBuffer(size, vk::BufferUsageFlagBits::eTransferDst,
+                 vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                 MemoryCategory::eStaging, readback_buffer, readback_buffer_memory);
+    copyBuffer(*particle_buffer, *readback_buffer, size);
+
+    auto jobs = JobSystem();
+    auto reference = ParticleSystemCpu(initialParticles(settings.particles.count, settings.particles.stiffness));
+    for (uint64_t i = 0; i < particle_steps; i++) {
+        reference.step(settings.particles.dt, settings.particles.stiffness, jobs);
+    }
+
+    auto gpu_particles = static_cast<const Particle *>(device->mapMemory(*readback_buffer_memory, 0, size));
+    float difference = reference.maxPositionDifference(gpu_particles, settings.particles.count);
+    device->unmapMemory(*readback_buffer_memory);
+
+    // GPU and CPU may contract the arithmetic differently, only expect the trajectories to stay close
+    const float tolerance = 1e-3f;
+    std::cout << "Particle validation after " << particle_steps << " steps: max position difference " << difference
+              << std::endl;
+    if (!(difference <= tolerance)) {
+        throw std::runtime_error("Particle simulation does not match the CPU reference!");
+    }
 }
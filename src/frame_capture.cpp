@@ -0,0 +1,418 @@
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static const std::array<uint32_t, 256> crc_table = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}();
+
+static uint32_t updateCrc(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void writeBigEndian(std::ostream &out, uint32_t value)
+{
+    char bytes[] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+    out.write(bytes, 4);
+}
+
+static void writePngChunk(std::ostream &out, const char *type, const std::vector<uint8_t> &data)
+{
+    writeBigEndian(out, static_cast<uint32_t>(data.size()));
+    out.write(type, 4);
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+    uint32_t crc = updateCrc(0xffffffffu, reinterpret_cast<const uint8_t *>(type), 4);
+    crc = updateCrc(crc, data.data(), data.size());
+    writeBigEndian(out, crc ^ 0xffffffffu);
+}
+
+// Writes an 8-bit RGB png. The image data goes into stored (uncompressed) deflate blocks: the writer has to
+// keep up with the frame rate, and a real deflate pass would cost more than the extra disk bandwidth.
+static void writePng(const std::string &filename, uint32_t width, uint32_t height, const uint8_t *bgra, bool swap_red_blue)
+{
+    auto file = std::ofstream(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("Failed to open '") + filename + "'!");
+    }
+
+    const char signature[] = {char(0x89), 'P', 'N', 'G', '\r', '\n', char(0x1a), '\n'};
+    file.write(signature, sizeof(signature));
+
+    std::vector<uint8_t> header(13);
+    for (int i = 0; i < 4; i++) {
+        header[i] = uint8_t(width >> (24 - 8 * i));
+        header[4 + i] = uint8_t(height >> (24 - 8 * i));
+    }
+    header[8] = 8;  // bit depth
+    header[9] = 2;  // color type: RGB
+    header[10] = 0; // compression
+    header[11] = 0; // filter
+    header[12] = 0; // interlace
+    writePngChunk(file, "IHDR", header);
+
+    // Filtered scanlines: one filter byte (none) followed by the RGB pixels
+    size_t row_size = 1 + size_t(width) * 3;
+    std::vector<uint8_t> raw(row_size * height);
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *row = raw.data() + y * row_size;
+        const uint8_t *src = bgra + size_t(y) * width * 4;
+        row[0] = 0;
+        for (uint32_t x = 0; x < width; x++) {
+            row[1 + 3 * x + 0] = src[4 * x + (swap_red_blue ? 2 : 0)];
+            row[1 + 3 * x + 1] = src[4 * x + 1];
+            row[1 + 3 * x + 2] = src[4 * x + (swap_red_blue ? 0 : 2)];
+        }
+    }
+
+    const size_t max_block_size = 65535;
+    size_t block_count = (raw.size() + max_block_size - 1) / max_block_size;
+    std::vector<uint8_t> idat;
+    idat.reserve(2 + raw.size() + 5 * block_count + 4);
+    idat.push_back(0x78); // zlib header: deflate, 32K window
+    idat.push_back(0x01);
+
+    uint32_t adler_a = 1, adler_b = 0;
+    for (size_t offset = 0; offset < raw.size(); offset += max_block_size) {
+        auto block_size = static_cast<uint16_t>(std::min(max_block_size, raw.size() - offset));
+        bool final_block = offset + block_size == raw.size();
+        idat.push_back(final_block ? 1 : 0);
+        idat.push_back(uint8_t(block_size));
+        idat.push_back(uint8_t(block_size >> 8));
+        auto inverted_size = static_cast<uint16_t>(~block_size);
+        idat.push_back(uint8_t(inverted_size));
+        idat.push_back(uint8_t(inverted_size >> 8));
+        idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + block_size);
+
+        for (size_t i = offset; i < offset + block_size; i++) {
+            adler_a = (adler_a + raw[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+    uint32_t adler = (adler_b << 16) | adler_a;
+    for (int i = 0; i < 4; i++) {
+        idat.push_back(uint8_t(adler >> (24 - 8 * i)));
+    }
+    writePngChunk(file, "IDAT", idat);
+    writePngChunk(file, "IEND", {});
+}
+
+FrameCapture::FrameCapture(MemoryTracker &memory_tracker, const vk::UniqueDevice &device, uint32_t queue_family_index,
+                           const CaptureSettings &settings)
+    : memory_tracker(memory_tracker), device(device), settings(settings), slots(std::max(settings.ring_size, 1u)),
+      active_slots(slots.size())
+{
+    std::filesystem::create_directories(settings.output_directory);
+
+    auto pool_create_info = vk::CommandPoolCreateInfo(
+        vk::CommandPoolCreateFlagBits::eResetCommandBuffer, // flags
+        queue_family_index                                  // queueFamilyIndex
+    );
+    command_pool = device->createCommandPoolUnique(pool_create_info);
+
+    auto alloc_info = vk::CommandBufferAllocateInfo(
+        *command_pool,                    // commandPool
+        vk::CommandBufferLevel::ePrimary, // level
+        (uint32_t)slots.size()            // commandBufferCount
+    );
+    auto command_buffers = device->allocateCommandBuffers(alloc_info);
+
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].command_buffer = command_buffers[i];
+        slots[i].fence = device->createFenceUnique(vk::FenceCreateInfo());
+    }
+
+    writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stop_writer = true;
+    }
+    queue_condition.notify_all();
+    writer.join();
+
+    std::cout << "Frame capture: " << frame_counter << " frames captured, " << dropped_frames << " dropped" << std::endl;
+}
+
+void FrameCapture::destroyBuffers()
+{
+    for (auto &slot : slots) {
+        if (slot.mapped) {
+            device->unmapMemory(*slot.memory);
+            slot.mapped = nullptr;
+        }
+        slot.buffer.reset();
+        slot.memory.reset();
+    }
+}
+
+void FrameCapture::resize(vk::Extent2D new_extent, vk::Format new_format)
+{
+    if (new_format != vk::Format::eB8G8R8A8Srgb && new_format != vk::Format::eB8G8R8A8Unorm &&
+        new_format != vk::Format::eR8G8B8A8Srgb && new_format != vk::Format::eR8G8B8A8Unorm) {
+        throw std::runtime_error("Frame capture does not support the swap chain image format!");
+    }
+
+    flush();
+    destroyBuffers();
+    extent = new_extent;
+    format = new_format;
+
+    vk::DeviceSize size = vk::DeviceSize(extent.width) * extent.height * 4;
+    for (size_t i = 0; i < active_slots; i++) {
+        auto &slot = slots[i];
+        auto buffer_create_info = vk::BufferCreateInfo(
+            {},                                    // flags
+            size,                                  // size
+            vk::BufferUsageFlagBits::eTransferDst, // usage
+            vk::SharingMode::eExclusive            // sharingMode
+        );
+        slot.buffer = device->createBufferUnique(buffer_create_info);
+
+        // Reading back from uncached memory is very slow, prefer cached memory even if it is not coherent
+        auto requirements = device->getBufferMemoryRequirements(*slot.buffer);
+        auto cached = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached;
+        auto coherent = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        auto properties = memory_tracker.tryFindMemoryType(requirements.memoryTypeBits, cached) ? cached : coherent;
+        slot.memory = memory_tracker.allocate(requirements, properties, MemoryCategory::eStaging);
+        memory_coherent = bool(slot.memory.propertyFlags() & vk::MemoryPropertyFlagBits::eHostCoherent);
+        device->bindBufferMemory(*slot.buffer, *slot.memory, 0);
+        slot.mapped = device->mapMemory(*slot.memory, 0, VK_WHOLE_SIZE);
+    }
+}
+
+void FrameCapture::shrink()
+{
+    if (active_slots == 1) {
+        return;
+    }
+
+    flush();
+    for (size_t i = 1; i < active_slots; i++) {
+        device->unmapMemory(*slots[i].memory);
+        slots[i].mapped = nullptr;
+        slots[i].buffer.reset();
+        slots[i].memory.reset();
+    }
+    active_slots = 1;
+    next_slot = 0;
+    std::cerr << "Frame capture: memory pressure, staging ring reduced to one buffer" << std::endl;
+}
+
+void FrameCapture::collect()
+{
+    for (size_t i = 0; i < active_slots; i++) {
+        // Walk the ring from the oldest submission so frames reach the writer in order
+        auto &slot = slots[(next_slot + i) % active_slots];
+        if (slot.state != eInFlight || device->getFenceStatus(*slot.fence) != vk::Result::eSuccess) {
+            continue;
+        }
+        slot.state = eWriting;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            write_queue.push_back((next_slot + i) % active_slots);
+        }
+        queue_condition.notify_all();
+    }
+}
+
+std::optional<size_t> FrameCapture::acquireSlot()
+{
+    collect();
+
+    if (slots[next_slot].state != eFree) {
+        dropped_frames++;
+        return std::nullopt;
+    }
+    size_t slot = next_slot;
+    next_slot = (next_slot + 1) % active_slots;
+    return slot;
+}
+
+void FrameCapture::submit(size_t slot_index, const vk::Queue &queue, const vk::Image &image, const vk::Semaphore &signal_semaphore)
+{
+    auto &slot = slots[slot_index];
+    auto &command_buffer = slot.command_buffer;
+
+    command_buffer.reset({});
+    command_buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+    auto color_range = vk::ImageSubresourceRange(
+        vk::ImageAspectFlagBits::eColor, // aspectMask
+        0,                               // baseMipLevel
+        1,                               // levelCount
+        0,                               // baseArrayLayer
+        1                                // layerCount
+    );
+
+    // The image was last written by the render pass, or by the upscaling blit with dynamic resolution
+    auto to_transfer_src = vk::ImageMemoryBarrier(
+        vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite, // srcAccessMask
+        vk::AccessFlagBits::eTransferRead,                                              // dstAccessMask
+        vk::ImageLayout::ePresentSrcKHR,                                                // oldLayout
+        vk::ImageLayout::eTransferSrcOptimal,                                           // newLayout
+        VK_QUEUE_FAMILY_IGNORED,                                                        // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                                                        // dstQueueFamilyIndex
+        image,                                                                          // image
+        color_range                                                                     // subresourceRange
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer, // srcStageMask
+        vk::PipelineStageFlagBits::eTransfer,                                                     // dstStageMask
+        {},                                                                                       // dependencyFlags
+        nullptr,                                                                                  // memoryBarriers
+        nullptr,                                                                                  // bufferMemoryBarriers
+        to_transfer_src                                                                           // imageMemoryBarriers
+    );
+
+    auto region = vk::BufferImageCopy(
+        0, // bufferOffset
+        0, // bufferRowLength
+        0, // bufferImageHeight
+        vk::ImageSubresourceLayers(
+            vk::ImageAspectFlagBits::eColor, // aspectMask
+            0,                               // mipLevel
+            0,                               // baseArrayLayer
+            1                                // layerCount
+            ),                                       // imageSubresource
+        vk::Offset3D(0, 0, 0),                       // imageOffset
+        vk::Extent3D(extent.width, extent.height, 1) // imageExtent
+    );
+    command_buffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, *slot.buffer, region);
+
+    auto to_present_src = vk::ImageMemoryBarrier(
+        vk::AccessFlagBits::eTransferRead,    // srcAccessMask
+        {},                                   // dstAccessMask
+        vk::ImageLayout::eTransferSrcOptimal, // oldLayout
+        vk::ImageLayout::ePresentSrcKHR,      // newLayout
+        VK_QUEUE_FAMILY_IGNORED,              // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,              // dstQueueFamilyIndex
+        image,                                // image
+        color_range                           // subresourceRange
+    );
+    auto to_host = vk::BufferMemoryBarrier(
+        vk::AccessFlagBits::eTransferWrite, // srcAccessMask
+        vk::AccessFlagBits::eHostRead,      // dstAccessMask
+        VK_QUEUE_FAMILY_IGNORED,            // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,            // dstQueueFamilyIndex
+        *slot.buffer,                       // buffer
+        0,                                  // offset
+        VK_WHOLE_SIZE                       // size
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,                                    // srcStageMask
+        vk::PipelineStageFlagBits::eBottomOfPipe | vk::PipelineStageFlagBits::eHost, // dstStageMask
+        {},                                                                      // dependencyFlags
+        nullptr,                                                                 // memoryBarriers
+        to_host,                                                                 // bufferMemoryBarriers
+        to_present_src                                                           // imageMemoryBarriers
+    );
+
+    command_buffer.end();
+
+    auto submit_info = vk::SubmitInfo(
+        0,                 // waitSemaphroeCount
+        nullptr,           // *waitSemaphores
+        nullptr,           // *waitDstStageMask
+        1,                 // commandBufferCount
+        &command_buffer,   // *commandBuffers
+        1,                 // signalSemaphoreCount
+        &signal_semaphore  // *signalSemaphores
+    );
+
+    device->resetFences(*slot.fence);
+    queue.submit(submit_info, *slot.fence);
+
+    slot.frame_index = frame_counter++;
+    slot.state = eInFlight;
+}
+
+void FrameCapture::flush()
+{
+    for (auto &slot : slots) {
+        if (slot.state == eInFlight) {
+            device->waitForFences(*slot.fence, VK_TRUE, UINT64_MAX);
+        }
+    }
+    collect();
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_condition.wait(lock, [this] {
+        return std::all_of(slots.cbegin(), slots.cend(), [](const auto &slot) { return slot.state == eFree; });
+    });
+}
+
+void FrameCapture::writerLoop()
+{
+    while (true) {
+        size_t slot_index;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this] { return stop_writer || !write_queue.empty(); });
+            if (write_queue.empty()) {
+                return;
+            }
+            slot_index = write_queue.front();
+            write_queue.pop_front();
+        }
+
+        try {
+            writeSlot(slots[slot_index]);
+        } catch (const std::exception &e) {
+            std::cerr << "Frame capture: " << e.what() << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            slots[slot_index].state = eFree;
+        }
+        queue_condition.notify_all();
+    }
+}
+
+void FrameCapture::writeSlot(Slot &slot)
+{
+    if (!memory_coherent) {
+        device->invalidateMappedMemoryRanges(vk::MappedMemoryRange(*slot.memory, 0, VK_WHOLE_SIZE));
+    }
+
+    bool raw = settings.format == CaptureFormat::eRaw;
+    auto filename = std::ostringstream();
+    filename << settings.output_directory << "/frame_" << std::setfill('0') << std::setw(6) << slot.frame_index
+             << (raw ? ".raw" : ".png");
+
+    auto data = static_cast<const uint8_t *>(slot.mapped);
+    if (raw) {
+        // Tightly packed rows of 4 bytes per pixel, in the swap chain's own channel order
+        auto file = std::ofstream(filename.str(), std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error(std::string("Failed to open '") + filename.str() + "'!");
+        }
+        file.write(reinterpret_cast<const char *>(data), size_t(extent.width) * extent.height * 4);
+    } else {
+        bool bgra = format == vk::Format::eB8G8R8A8Srgb || format == vk::Format::eB8G8R8A8Unorm;
+        writePng(filename.str(), extent.width, extent.height, data, bgra);
+    }
+}
@@ -0,0 +1,168 @@
+#include "job_system.hpp"
+
+thread_local const JobSystem *JobSystem::current_pool = nullptr;
+thread_local size_t JobSystem::current_queue = 0;
+
+// Only the owner pushes and pops, any thread steals. Memory orders follow Lê et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models".
+bool JobSystem::Deque::push(Job *job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity) {
+        return false;
+    }
+    jobs[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+JobSystem::Job *JobSystem::Deque::pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job *job = jobs[b & (capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last job, race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job *JobSystem::Deque::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return nullptr;
+    }
+    Job *job = jobs[t & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+unsigned int JobSystem::defaultWorkerCount()
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads > 1 ? threads - 1 : 0;
+}
+
+JobSystem::JobSystem(unsigned int worker_count)
+{
+    for (unsigned int i = 0; i <= worker_count; i++) {
+        queues.push_back(std::make_unique<Deque>());
+    }
+    for (unsigned int i = 1; i <= worker_count; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_condition.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::submit(Job *jobs, size_t job_count)
+{
+    Deque &queue = *queues[queueIndex()];
+    size_t pushed = 0;
+    for (; pushed < job_count; pushed++) {
+        if (!queue.push(&jobs[pushed])) {
+            break;
+        }
+    }
+    queued_jobs.fetch_add(static_cast<int64_t>(pushed));
+    // Pairs with the increment in workerLoop(): either the sleeper sees the jobs or we see the sleeper
+    if (sleeping_workers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_condition.notify_all();
+    }
+
+    for (; pushed < job_count; pushed++) {
+        execute(&jobs[pushed]);
+    }
+}
+
+void JobSystem::execute(Job *job)
+{
+    Batch &batch = *job->batch;
+    try {
+        job->invoke(job->function, job->begin, job->end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(batch.error_mutex);
+        if (!batch.error) {
+            batch.error = std::current_exception();
+        }
+    }
+    batch.remaining.fetch_sub(1, std::memory_order_release);
+}
+
+JobSystem::Job *JobSystem::findJob(size_t queue_index, uint32_t &random)
+{
+    Job *job = queues[queue_index]->pop();
+    if (!job) {
+        // Start from a random victim so thieves spread over the queues
+        random = random * 1664525u + 1013904223u;
+        size_t queue_count = queues.size();
+        size_t first = (random >> 8) % queue_count;
+        for (size_t i = 0; i < queue_count && !job; i++) {
+            size_t victim = (first + i) % queue_count;
+            if (victim != queue_index) {
+                job = queues[victim]->steal();
+            }
+        }
+    }
+    if (job) {
+        queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::workerLoop(size_t queue_index)
+{
+    current_pool = this;
+    current_queue = queue_index;
+    uint32_t random = static_cast<uint32_t>(queue_index) * 2654435761u + 1;
+    unsigned int idle_rounds = 0;
+
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (Job *job = findJob(queue_index, random)) {
+            execute(job);
+            idle_rounds = 0;
+            continue;
+        }
+        // Spin a little for the next batch of a frame before going to sleep
+        if (++idle_rounds < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        sleeping_workers.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_condition.wait(lock, [this] { return stopping.load() || queued_jobs.load() > 0; });
+        }
+        sleeping_workers.fetch_sub(1);
+        idle_rounds = 0;
+    }
+}
@@ -1,10 +1,174 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <string>
 
 #include "application.hpp"
 
-int main()
+static bool hasValue(int i, int argc, char **argv)
 {
-    auto app = Application();
+    return i + 1 < argc && argv[i + 1][0] != '-';
+}
+
+static int usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [--windows count] [--capture [directory]] [--capture-format png|raw]"
+              << " [--particles [count]] [--validate-particles [frames]] [--bench-particles [count]]"
+              << " [--mesh file] [--convert-mesh input output] [--scene [nodes]] [--bench-scene [nodes]]"
+              << " [--dynamic-resolution [budget_ms]] [--scene-features none|lighting,colors] [--uber-shader]"
+              << " [--bench-scene-shader [frames]] [--check-mesh-loader]" << '\n';
+    return EXIT_FAILURE;
+}
+
+// Counts are whole numbers greater than 0, anything else is rejected instead of read partially
+static bool parseCount(const char *text, unsigned int &count)
+{
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    unsigned long value = std::strtoul(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value == 0 || value > std::numeric_limits<unsigned int>::max()) {
+        return false;
+    }
+    count = static_cast<unsigned int>(value);
+    return true;
+}
+
+static bool parseMilliseconds(const char *text, double &milliseconds)
+{
+    char *end;
+    errno = 0;
+    double value = std::strtod(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE || !std::isfinite(value) || value <= 0.0) {
+        return false;
+    }
+    milliseconds = value;
+    return true;
+}
+
+// Comma separated scene feature names, or none
+static bool parseSceneFeatures(const std::string &list, uint32_t &features)
+{
+    features = 0;
+    if (list == "none") {
+        return true;
+    }
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = std::min(list.find(',', begin), list.size());
+        auto name = list.substr(begin, end - begin);
+        uint32_t id = 0;
+        while (id < SceneVariants::feature_count && name != scene_feature_names[id]) {
+            id++;
+        }
+        if (id == SceneVariants::feature_count) {
+            return false;
+        }
+        features |= 1u << id;
+        begin = end + 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned int default_particle_count = 1 << 20;
+    const unsigned int default_scene_node_count = 100000;
+    auto settings = ApplicationSettings();
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--capture") == 0) {
+            settings.capture.enabled = true;
+            if (hasValue(i, argc, argv)) {
+                settings.capture.output_directory = argv[++i];
+            }
+        } else if (std::strcmp(argv[i], "--capture-format") == 0 && hasValue(i, argc, argv) &&
+                   (std::strcmp(argv[i + 1], "png") == 0 || std::strcmp(argv[i + 1], "raw") == 0)) {
+            settings.capture.format = std::strcmp(argv[++i], "raw") == 0 ? CaptureFormat::eRaw : CaptureFormat::ePng;
+        } else if (std::strcmp(argv[i], "--particles") == 0) {
+            settings.particles.count = default_particle_count;
+            if (hasValue(i, argc, argv) && !parseCount(argv[++i], settings.particles.count)) {
+                return usage(argv[0]);
+            }
+        } else if (std::strcmp(argv[i], "--validate-particles") == 0) {
+            settings.particles.validation_frames = 300;
+            if (hasValue(i, argc, argv) && !parseCount(argv[++i], settings.particles.validation_frames)) {
+                return usage(argv[0]);
+            }
+            if (settings.particles.count == 0) {
+                settings.particles.count = default_particle_count;
+            }
+        } else if (std::strcmp(argv[i], "--windows") == 0 && hasValue(i, argc, argv) &&
+                   parseCount(argv[i + 1], settings.window_count)) {
+            i++;
+        } else if (std::strcmp(argv[i], "--mesh") == 0 && hasValue(i, argc, argv)) {
+            settings.mesh.path = argv[++i];
+        } else if (std::strcmp(argv[i], "--convert-mesh") == 0 && hasValue(i, argc, argv) && hasValue(i + 1, argc, argv)) {
+            try {
+                auto jobs = JobSystem();
+                writeMeshBlob(argv[i + 2], convertMesh(argv[i + 1], jobs));
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        } else if (std::strcmp(argv[i], "--check-mesh-loader") == 0) {
+            auto jobs = JobSystem();
+            return checkObjLoader(jobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } else if (std::strcmp(argv[i], "--scene") == 0) {
+            settings.scene.node_count = default_scene_node_count;
+            if (hasValue(i, argc, argv) && !parseCount(argv[++i], settings.scene.node_count)) {
+                return usage(argv[0]);
+            }
+        } else if (std::strcmp(argv[i], "--bench-scene") == 0) {
+            unsigned int node_count = default_scene_node_count;
+            if (hasValue(i, argc, argv) && !parseCount(argv[++i], node_count)) {
+                return usage(argv[0]);
+            }
+            runSceneBenchmark(node_count, 100);
+            return EXIT_SUCCESS;
+        } else if (std::strcmp(argv[i], "--dynamic-resolution") == 0) {
+            settings.dynamic_resolution.enabled = true;
+            if (hasValue(i, argc, argv) && !parseMilliseconds(argv[++i], settings.dynamic_resolution.frame_budget)) {
+                return usage(argv[0]);
+            }
+        } else if (std::strcmp(argv[i], "--scene-features") == 0 && hasValue(i, argc, argv) &&
+                   parseSceneFeatures(argv[i + 1], settings.scene_shader.features)) {
+            i++;
+        } else if (std::strcmp(argv[i], "--uber-shader") == 0) {
+            settings.scene_shader.uber_shader = true;
+        } else if (std::strcmp(argv[i], "--bench-scene-shader") == 0) {
+            settings.scene_shader.bench_frames = 300;
+            if (hasValue(i, argc, argv) && !parseCount(argv[++i], settings.scene_shader.bench_frames)) {
+                return usage(argv[0]);
+            }
+            if (settings.scene.node_count == 0) {
+                settings.scene.node_count = default_scene_node_count;
+            }
+        } else if (std::strcmp(argv[i], "--bench-particles") == 0) {
+            unsigned int particle_count = default_particle_count;
+            if (hasValue(i, argc, argv) && !parseCount(argv[++i], particle_count)) {
+                return usage(argv[0]);
+            }
+            runParticleBenchmark(particle_count, 100);
+            return EXIT_SUCCESS;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    // The benchmark reads the GPU time from the dynamic resolution queries, with a budget that keeps the full scale
+    if (settings.scene_shader.bench_frames > 0) {
+        settings.dynamic_resolution.enabled = true;
+        settings.dynamic_resolution.frame_budget = std::numeric_limits<double>::infinity();
+    }
+
+    auto app = Application(settings);
 
     try {
         app.run();
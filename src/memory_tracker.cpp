@@ -0,0 +1,227 @@
+#include "memory_tracker.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static double toMiB(vk::DeviceSize bytes)
+{
+    return double(bytes) / (1024.0 * 1024.0);
+}
+
+const char *memoryCategoryName(MemoryCategory category)
+{
+    switch (category) {
+    case MemoryCategory::eSwapchain:
+        return "swapchain";
+    case MemoryCategory::eBuffer:
+        return "buffers";
+    case MemoryCategory::eImage:
+        return "images";
+    case MemoryCategory::eStaging:
+        return "staging";
+    }
+    return "unknown";
+}
+
+float MemorySnapshot::pressure() const
+{
+    float pressure = 0.0f;
+    for (const auto &heap : heaps) {
+        if (heap.budget > 0) {
+            pressure = std::max(pressure, float(heap.usage) / float(heap.budget));
+        }
+    }
+    return pressure;
+}
+
+std::string MemorySnapshot::summary() const
+{
+    vk::DeviceSize usage = 0, budget = 0;
+    for (const auto &heap : heaps) {
+        if (heap.device_local) {
+            usage += heap.usage;
+            budget += heap.budget;
+        }
+    }
+
+    auto out = std::ostringstream();
+    out << std::fixed << std::setprecision(1) << "VRAM " << toMiB(usage) << "/" << toMiB(budget) << " MiB";
+    if (!from_budget_extension) {
+        out << " (est.)";
+    }
+    for (size_t i = 0; i < memory_category_count; i++) {
+        out << " | " << memoryCategoryName(MemoryCategory(i)) << " " << toMiB(category_bytes[i]);
+    }
+    return out.str();
+}
+
+void MemorySnapshot::log(std::ostream &out) const
+{
+    out << "Device memory" << (from_budget_extension ? "" : " (estimated, VK_EXT_memory_budget unavailable)") << ":\n";
+    out << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < heaps.size(); i++) {
+        out << "  heap " << i << (heaps[i].device_local ? " (device local)" : "") << ": "
+            << toMiB(heaps[i].usage) << " / " << toMiB(heaps[i].budget) << " MiB used, "
+            << toMiB(heaps[i].size) << " MiB total\n";
+    }
+    for (size_t i = 0; i < memory_category_count; i++) {
+        out << "  " << memoryCategoryName(MemoryCategory(i)) << ": " << category_allocations[i] << " allocations, "
+            << toMiB(category_bytes[i]) << " MiB\n";
+    }
+    out << std::defaultfloat << std::flush;
+}
+
+void TrackedMemory::reset()
+{
+    if (memory) {
+        tracker->release(category, heap_index, size);
+        memory.reset();
+    }
+    tracker = nullptr;
+}
+
+void TrackedMemory::swap(TrackedMemory &other) noexcept
+{
+    std::swap(tracker, other.tracker);
+    std::swap(memory, other.memory);
+    std::swap(property_flags, other.property_flags);
+    std::swap(size, other.size);
+    std::swap(category, other.category);
+    std::swap(heap_index, other.heap_index);
+}
+
+MemoryTracker::MemoryTracker(const vk::PhysicalDevice &physical_device, const vk::UniqueDevice &device,
+                             const vk::DispatchLoaderDynamic &dldy, bool budget_extension_enabled)
+    : physical_device(physical_device), device(device), dldy(dldy), budget_extension_enabled(budget_extension_enabled)
+{
+    memory_properties = physical_device.getMemoryProperties();
+    heap_bytes.resize(memory_properties.memoryHeapCount);
+
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if (memory_properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+            external_heap_index = i;
+            break;
+        }
+    }
+}
+
+std::optional<uint32_t> MemoryTracker::tryFindMemoryType(uint32_t type_filter, vk::MemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+uint32_t MemoryTracker::findMemoryType(uint32_t type_filter, vk::MemoryPropertyFlags properties) const
+{
+    auto memory_type_index = tryFindMemoryType(type_filter, properties);
+    if (!memory_type_index) {
+        throw std::runtime_error("Failed to find a suitable memory type!");
+    }
+    return *memory_type_index;
+}
+
+TrackedMemory MemoryTracker::allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties,
+                                      MemoryCategory category)
+{
+    auto memory_type_index = findMemoryType(requirements.memoryTypeBits, properties);
+
+    auto alloc_info = vk::MemoryAllocateInfo(
+        requirements.size, // allocationSize
+        memory_type_index  // memoryTypeIndex
+    );
+
+    auto tracked = TrackedMemory();
+    tracked.memory = device->allocateMemoryUnique(alloc_info);
+    tracked.tracker = this;
+    tracked.property_flags = memory_properties.memoryTypes[memory_type_index].propertyFlags;
+    tracked.size = requirements.size;
+    tracked.category = category;
+    tracked.heap_index = memory_properties.memoryTypes[memory_type_index].heapIndex;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    category_bytes[size_t(category)] += tracked.size;
+    category_allocations[size_t(category)]++;
+    heap_bytes[tracked.heap_index] += tracked.size;
+
+    return tracked;
+}
+
+void MemoryTracker::release(MemoryCategory category, uint32_t heap_index, vk::DeviceSize size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    category_bytes[size_t(category)] -= size;
+    category_allocations[size_t(category)]--;
+    heap_bytes[heap_index] -= size;
+}
+
+void MemoryTracker::setExternalUsage(MemoryCategory category, vk::DeviceSize bytes, uint32_t allocation_count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    heap_bytes[external_heap_index] += bytes - external_bytes[size_t(category)];
+    external_bytes[size_t(category)] = bytes;
+    external_allocations[size_t(category)] = allocation_count;
+}
+
+MemorySnapshot MemoryTracker::snapshot() const
+{
+    auto snapshot = MemorySnapshot();
+    snapshot.heaps.resize(memory_properties.memoryHeapCount);
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        snapshot.heaps[i].size = memory_properties.memoryHeaps[i].size;
+        snapshot.heaps[i].device_local = bool(memory_properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < memory_category_count; i++) {
+        snapshot.category_bytes[i] = category_bytes[i] + external_bytes[i];
+        snapshot.category_allocations[i] = category_allocations[i] + external_allocations[i];
+    }
+
+    if (budget_extension_enabled) {
+        // Usage reported by the driver includes other processes' allocations on the same heaps
+        auto budget_properties = vk::PhysicalDeviceMemoryBudgetPropertiesEXT();
+        auto memory_properties2 = vk::PhysicalDeviceMemoryProperties2();
+        memory_properties2.pNext = &budget_properties;
+        physical_device.getMemoryProperties2KHR(&memory_properties2, dldy);
+
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+            snapshot.heaps[i].budget = budget_properties.heapBudget[i];
+            snapshot.heaps[i].usage = budget_properties.heapUsage[i];
+        }
+        snapshot.from_budget_extension = true;
+    } else {
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+            snapshot.heaps[i].budget = snapshot.heaps[i].size;
+            snapshot.heaps[i].usage = heap_bytes[i];
+        }
+    }
+
+    return snapshot;
+}
+
+void MemoryTracker::addPressureCallback(float threshold, PressureCallback callback)
+{
+    pressure_listeners.push_back({threshold, std::move(callback)});
+}
+
+MemorySnapshot MemoryTracker::update()
+{
+    auto current = snapshot();
+    auto pressure = current.pressure();
+
+    for (auto &listener : pressure_listeners) {
+        if (pressure >= listener.threshold && !listener.triggered) {
+            listener.triggered = true;
+            listener.callback(current);
+        } else if (pressure < listener.threshold) {
+            listener.triggered = false;
+        }
+    }
+
+    return current;
+}
@@ -0,0 +1,513 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+static const char mesh_blob_magic[4] = {'V', 'K', 'M', 'B'};
+static const uint32_t mesh_blob_version = 1;
+
+// FIFO post-transform cache model, as found in most hardware
+class FifoCache
+{
+  public:
+    FifoCache(size_t vertex_count, unsigned int size) : timestamps(vertex_count, 0), size(size), time(size + 1) {}
+
+    // True if the vertex had to be transformed
+    bool access(uint32_t vertex)
+    {
+        if (time - timestamps[vertex] > size) {
+            timestamps[vertex] = time++;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() { time += size + 1; }
+
+  private:
+    std::vector<uint32_t> timestamps;
+    uint32_t size;
+    uint32_t time;
+};
+
+float averageCacheMissRatio(const std::vector<uint32_t> &indices, size_t vertex_count, unsigned int cache_size)
+{
+    if (indices.empty()) {
+        return 0.0f;
+    }
+    auto cache = FifoCache(vertex_count, cache_size);
+    size_t misses = 0;
+    for (auto index : indices) {
+        misses += cache.access(index);
+    }
+    return float(misses) / float(indices.size() / 3);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertex_count)
+{
+    // Scores from Tom Forsyth, "Linear-Speed Vertex Cache Optimisation". The simulated LRU cache is smaller than the
+    // 32 entries of the paper, it is rescored after every triangle and that dominates the running time.
+    const int cache_size = 16;
+    const int max_valence = 64;
+    float cache_scores[cache_size];
+    for (int i = 0; i < cache_size; i++) {
+        cache_scores[i] = i < 3 ? 0.75f : std::pow(1.0f - float(i - 3) / float(cache_size - 3), 1.5f);
+    }
+    float valence_scores[max_valence];
+    valence_scores[0] = 0.0f;
+    for (int i = 1; i < max_valence; i++) {
+        valence_scores[i] = 2.0f / std::sqrt(float(i));
+    }
+
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Triangles using each vertex, the first live_triangles[v] entries are the ones not emitted yet
+    auto live_triangles = std::vector<uint32_t>(vertex_count, 0);
+    for (auto index : indices) {
+        live_triangles[index]++;
+    }
+    auto adjacency_offsets = std::vector<uint32_t>(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + live_triangles[v];
+    }
+    auto adjacency = std::vector<uint32_t>(indices.size());
+    {
+        auto fill = std::vector<uint32_t>(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    auto cache_positions = std::vector<int>(vertex_count, -1);
+    auto vertex_score = [&](uint32_t vertex) {
+        uint32_t valence = live_triangles[vertex];
+        if (valence == 0) {
+            return -1.0f;
+        }
+        int position = cache_positions[vertex];
+        return (position >= 0 ? cache_scores[position] : 0.0f) + valence_scores[std::min(valence, uint32_t(max_valence - 1))];
+    };
+
+    auto vertex_scores = std::vector<float>(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = vertex_score(v);
+    }
+    auto triangle_scores = std::vector<float>(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++) {
+        triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+    }
+    auto emitted = std::vector<bool>(triangle_count, false);
+
+    auto result = std::vector<uint32_t>();
+    result.reserve(indices.size());
+    uint32_t cache[cache_size + 3];
+    int cache_count = 0;
+    size_t cursor = 0;
+    size_t current = size_t(std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin());
+
+    while (true) {
+        const uint32_t *triangle = indices.data() + current * 3;
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[current] = true;
+
+        // The triangle's vertices move to the front of the cache
+        uint32_t new_cache[cache_size + 3];
+        int new_count = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t vertex = triangle[k];
+            new_cache[new_count++] = vertex;
+
+            uint32_t *list = adjacency.data() + adjacency_offsets[vertex];
+            uint32_t &live = live_triangles[vertex];
+            auto it = std::find(list, list + live, uint32_t(current));
+            std::swap(*it, list[live - 1]);
+            live--;
+        }
+        for (int i = 0; i < cache_count; i++) {
+            uint32_t vertex = cache[i];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                new_cache[new_count++] = vertex;
+            }
+        }
+
+        // Rescore the vertices in the cache, including the ones just pushed out of it, and their triangles
+        for (int i = 0; i < new_count; i++) {
+            uint32_t vertex = new_cache[i];
+            cache_positions[vertex] = i < cache_size ? i : -1;
+            float score = vertex_score(vertex);
+            float delta = score - vertex_scores[vertex];
+            vertex_scores[vertex] = score;
+
+            const uint32_t *list = adjacency.data() + adjacency_offsets[vertex];
+            for (uint32_t j = 0; j < live_triangles[vertex]; j++) {
+                triangle_scores[list[j]] += delta;
+            }
+        }
+
+        // The next triangle is the best one using a cached vertex
+        size_t best = SIZE_MAX;
+        float best_score = -1.0f;
+        for (int i = 0; i < std::min(new_count, cache_size); i++) {
+            const uint32_t *list = adjacency.data() + adjacency_offsets[new_cache[i]];
+            for (uint32_t j = 0; j < live_triangles[new_cache[i]]; j++) {
+                if (triangle_scores[list[j]] > best_score) {
+                    best_score = triangle_scores[list[j]];
+                    best = list[j];
+                }
+            }
+        }
+        cache_count = std::min(new_count, cache_size);
+        std::copy(new_cache, new_cache + cache_count, cache);
+
+        // Dead end: continue with the next triangle in input order
+        if (best == SIZE_MAX) {
+            while (cursor < triangle_count && emitted[cursor]) {
+                cursor++;
+            }
+            if (cursor == triangle_count) {
+                break;
+            }
+            best = cursor;
+        }
+        current = best;
+    }
+
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<MeshVertex> &vertices, float threshold)
+{
+    const unsigned int cache_size = 16;
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Hard boundaries: triangles missing the cache on all three vertices most likely start a new patch
+    auto cache = FifoCache(vertices.size(), cache_size);
+    auto misses = std::vector<uint8_t>(triangle_count);
+    auto hard_boundaries = std::vector<size_t>();
+    for (size_t t = 0; t < triangle_count; t++) {
+        misses[t] = uint8_t(cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]));
+        if (t == 0 || misses[t] == 3) {
+            hard_boundaries.push_back(t);
+        }
+    }
+    hard_boundaries.push_back(triangle_count);
+
+    // Soft boundaries: split patches further wherever the cache efficiency so far stays within the threshold
+    auto clusters = std::vector<size_t>();
+    for (size_t c = 0; c + 1 < hard_boundaries.size(); c++) {
+        size_t begin = hard_boundaries[c], end = hard_boundaries[c + 1];
+        size_t cluster_misses = 0;
+        for (size_t t = begin; t < end; t++) {
+            cluster_misses += misses[t];
+        }
+        float cluster_threshold = threshold * float(cluster_misses) / float(end - begin);
+
+        cache.clear();
+        size_t running_misses = 0, running_triangles = 0;
+        clusters.push_back(begin);
+        for (size_t t = begin; t < end; t++) {
+            running_misses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+            running_triangles++;
+            if (t + 1 < end && float(running_misses) / float(running_triangles) <= cluster_threshold) {
+                clusters.push_back(t + 1);
+                cache.clear();
+                running_misses = running_triangles = 0;
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    // Area weighted centroid and normal of every cluster, and of the whole mesh
+    size_t cluster_count = clusters.size() - 1;
+    auto centroids = std::vector<float>(cluster_count * 3, 0.0f);
+    auto normals = std::vector<float>(cluster_count * 3, 0.0f);
+    float mesh_centroid[3] = {0.0f, 0.0f, 0.0f};
+    float mesh_area = 0.0f;
+    for (size_t c = 0; c < cluster_count; c++) {
+        float cluster_area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const float *a = vertices[indices[t * 3]].position;
+            const float *b = vertices[indices[t * 3 + 1]].position;
+            const float *d = vertices[indices[t * 3 + 2]].position;
+            float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            float v[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+            float normal[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+            float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            for (int k = 0; k < 3; k++) {
+                float center = (a[k] + b[k] + d[k]) / 3.0f;
+                centroids[c * 3 + k] += center * area;
+                normals[c * 3 + k] += normal[k];
+                mesh_centroid[k] += center * area;
+            }
+            cluster_area += area;
+        }
+        for (int k = 0; k < 3; k++) {
+            centroids[c * 3 + k] = cluster_area > 0.0f ? centroids[c * 3 + k] / cluster_area : 0.0f;
+        }
+        mesh_area += cluster_area;
+    }
+    for (int k = 0; k < 3; k++) {
+        mesh_centroid[k] = mesh_area > 0.0f ? mesh_centroid[k] / mesh_area : 0.0f;
+    }
+
+    // Clusters far out along their normal are likely to occlude the rest, draw them first
+    auto keys = std::vector<float>(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) {
+        const float *n = normals.data() + c * 3;
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float key = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            key += (centroids[c * 3 + k] - mesh_centroid[k]) * n[k];
+        }
+        keys[c] = length > 0.0f ? key / length : 0.0f;
+    }
+    auto order = std::vector<size_t>(cluster_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    auto result = std::vector<uint32_t>();
+    result.reserve(indices.size());
+    for (auto c : order) {
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+
+    // The clusters were measured with a cold cache each, so check the whole reordered mesh against the bound and
+    // keep the cache optimized input order if it is exceeded
+    float input_acmr = averageCacheMissRatio(indices, vertices.size(), cache_size);
+    if (averageCacheMissRatio(result, vertices.size(), cache_size) > threshold * input_acmr) {
+        return;
+    }
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(MeshData &mesh)
+{
+    auto remap = std::vector<uint32_t>(mesh.vertices.size(), UINT32_MAX);
+    auto vertices = std::vector<MeshVertex>();
+    vertices.reserve(mesh.vertices.size());
+    for (auto &index : mesh.indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = uint32_t(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    // Unreferenced vertices are dropped
+    mesh.vertices.swap(vertices);
+}
+
+MeshData createCubeMesh()
+{
+    auto mesh = MeshData();
+    for (int axis = 0; axis < 3; axis++) {
+        for (float sign : {-1.0f, 1.0f}) {
+            // Corners of the face in counter-clockwise order seen from outside
+            int u = (axis + (sign > 0.0f ? 1 : 2)) % 3;
+            int v = (axis + (sign > 0.0f ? 2 : 1)) % 3;
+            auto first = static_cast<uint32_t>(mesh.vertices.size());
+            const float corners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+            for (const auto &corner : corners) {
+                auto vertex = MeshVertex{};
+                vertex.position[axis] = sign;
+                vertex.position[u] = corner[0];
+                vertex.position[v] = corner[1];
+                vertex.normal[axis] = sign;
+                vertex.texcoord[0] = 0.5f + 0.5f * corner[0];
+                vertex.texcoord[1] = 0.5f + 0.5f * corner[1];
+                mesh.vertices.push_back(vertex);
+            }
+            for (uint32_t index : {0u, 1u, 2u, 0u, 2u, 3u}) {
+                mesh.indices.push_back(first + index);
+            }
+        }
+    }
+    return mesh;
+}
+
+void optimizeMesh(MeshData &mesh)
+{
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeOverdraw(mesh.indices, mesh.vertices);
+    optimizeVertexFetch(mesh);
+}
+
+static uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        return uint16_t(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0)); // inf, nan
+    }
+    if (magnitude >= 0x477ff000) {
+        return uint16_t(sign | 0x7c00); // rounds beyond the largest half
+    }
+    if (magnitude < 0x38800000) {
+        // Subnormal half, in units of 2^-24
+        float absolute;
+        std::memcpy(&absolute, &magnitude, 4);
+        return uint16_t(sign | uint32_t(std::lrint(absolute * 16777216.0f)));
+    }
+    // Rebias the exponent and round the mantissa to nearest even
+    uint32_t rounded = magnitude + 0xfff + ((magnitude >> 13) & 1);
+    return uint16_t(sign | ((rounded - 0x38000000) >> 13));
+}
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::vector<char> quantizeMesh(const MeshData &mesh)
+{
+    if (mesh.vertices.size() > UINT32_MAX || mesh.indices.size() > UINT32_MAX) {
+        throw std::runtime_error("Mesh too large for a mesh blob!");
+    }
+
+    auto header = MeshBlobHeader();
+    std::memcpy(header.magic, mesh_blob_magic, 4);
+    header.version = mesh_blob_version;
+    header.vertex_count = uint32_t(mesh.vertices.size());
+    header.index_count = uint32_t(mesh.indices.size());
+    header.index_size = mesh.vertices.size() <= 65536 ? 2 : 4;
+
+    float minimum[3] = {INFINITY, INFINITY, INFINITY}, maximum[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const auto &vertex : mesh.vertices) {
+        for (int k = 0; k < 3; k++) {
+            minimum[k] = std::min(minimum[k], vertex.position[k]);
+            maximum[k] = std::max(maximum[k], vertex.position[k]);
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        header.position_offset[k] = mesh.vertices.empty() ? 0.0f : minimum[k];
+        header.position_scale[k] = mesh.vertices.empty() ? 0.0f : maximum[k] - minimum[k];
+    }
+
+    size_t vertex_data_size = mesh.vertices.size() * sizeof(QuantizedVertex);
+    size_t index_data_size = mesh.indices.size() * header.index_size;
+    header.vertex_data_offset = alignUp(sizeof(MeshBlobHeader), 16);
+    header.index_data_offset = alignUp(header.vertex_data_offset + vertex_data_size, 16);
+
+    auto blob = std::vector<char>(header.index_data_offset + index_data_size, 0);
+    std::memcpy(blob.data(), &header, sizeof(header));
+
+    auto quantized = reinterpret_cast<QuantizedVertex *>(blob.data() + header.vertex_data_offset);
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const auto &vertex = mesh.vertices[i];
+        for (int k = 0; k < 3; k++) {
+            float unorm = header.position_scale[k] > 0.0f ? (vertex.position[k] - minimum[k]) / header.position_scale[k] : 0.0f;
+            quantized[i].position[k] = uint16_t(std::lrint(std::clamp(unorm, 0.0f, 1.0f) * 65535.0f));
+            quantized[i].normal[k] = int8_t(std::lrint(std::clamp(vertex.normal[k], -1.0f, 1.0f) * 127.0f));
+        }
+        quantized[i].position[3] = 0;
+        quantized[i].normal[3] = 0;
+        quantized[i].texcoord[0] = floatToHalf(vertex.texcoord[0]);
+        quantized[i].texcoord[1] = floatToHalf(vertex.texcoord[1]);
+    }
+
+    char *index_data = blob.data() + header.index_data_offset;
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+        if (header.index_size == 2) {
+            uint16_t index = uint16_t(mesh.indices[i]);
+            std::memcpy(index_data + i * 2, &index, 2);
+        } else {
+            std::memcpy(index_data + i * 4, &mesh.indices[i], 4);
+        }
+    }
+    return blob;
+}
+
+bool isMeshBlob(const char *data, size_t size)
+{
+    return size >= sizeof(MeshBlobHeader) && std::memcmp(data, mesh_blob_magic, 4) == 0;
+}
+
+MeshBlobView viewMeshBlob(const char *data, size_t size)
+{
+    if (!isMeshBlob(data, size)) {
+        throw std::runtime_error("Not a mesh blob!");
+    }
+    auto header = reinterpret_cast<const MeshBlobHeader *>(data);
+    if (header->version != mesh_blob_version) {
+        throw std::runtime_error("Unsupported mesh blob version!");
+    }
+    if ((header->index_size != 2 && header->index_size != 4) || header->index_count % 3 != 0) {
+        throw std::runtime_error("Malformed mesh blob!");
+    }
+
+    auto view = MeshBlobView();
+    view.header = header;
+    view.vertex_data_size = size_t(header->vertex_count) * sizeof(QuantizedVertex);
+    view.index_data_size = size_t(header->index_count) * header->index_size;
+    if (header->vertex_data_offset > size || size - header->vertex_data_offset < view.vertex_data_size ||
+        header->index_data_offset > size || size - header->index_data_offset < view.index_data_size ||
+        header->vertex_data_offset % alignof(QuantizedVertex) != 0 || header->index_data_offset % header->index_size != 0) {
+        throw std::runtime_error("Malformed mesh blob!");
+    }
+    view.vertex_data = data + header->vertex_data_offset;
+    view.index_data = data + header->index_data_offset;
+
+    // Out of range indices would read outside the vertex buffer on the GPU
+    for (uint32_t i = 0; i < header->index_count; i++) {
+        uint32_t index = 0;
+        std::memcpy(&index, static_cast<const char *>(view.index_data) + size_t(i) * header->index_size, header->index_size);
+        if (index >= header->vertex_count) {
+            throw std::runtime_error("Mesh blob index out of range!");
+        }
+    }
+    return view;
+}
+
+void writeMeshBlob(const std::string &path, const std::vector<char> &blob)
+{
+    auto file = std::ofstream(path, std::ios::binary);
+    if (!file.write(blob.data(), std::streamsize(blob.size()))) {
+        throw std::runtime_error("Failed to write '" + path + "'!");
+    }
+}
+
+std::vector<char> convertMesh(const std::string &path, JobSystem &jobs)
+{
+    using Clock = std::chrono::steady_clock;
+    auto milliseconds = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    auto start = Clock::now();
+    auto mesh = loadMesh(path, jobs);
+    double load_time = milliseconds(start);
+    float acmr_before = averageCacheMissRatio(mesh.indices, mesh.vertices.size());
+
+    start = Clock::now();
+    optimizeMesh(mesh);
+    double optimize_time = milliseconds(start);
+    float acmr_after = averageCacheMissRatio(mesh.indices, mesh.vertices.size());
+
+    start = Clock::now();
+    auto blob = quantizeMesh(mesh);
+    double quantize_time = milliseconds(start);
+
+    std::cout << std::fixed << std::setprecision(1) << "Mesh '" << path << "': " << mesh.indices.size() / 3
+              << " triangles, " << mesh.vertices.size() << " vertices\n"
+              << "  load " << load_time << " ms, optimize " << optimize_time << " ms, quantize " << quantize_time << " ms\n"
+              << std::setprecision(3) << "  ACMR (FIFO 16) " << acmr_before << " -> " << acmr_after << "\n"
+              << std::setprecision(1) << "  vertex data " << double(mesh.vertices.size() * sizeof(MeshVertex)) / 1048576.0
+              << " -> " << double(mesh.vertices.size() * sizeof(QuantizedVertex)) / 1048576.0 << " MiB, blob "
+              << double(blob.size()) / 1048576.0 << " MiB" << std::defaultfloat << std::endl;
+    return blob;
+}
@@ -0,0 +1,1205 @@
+#include "mesh.hpp"
+
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path)
+{
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size)) {
+        throw std::runtime_error("Failed to open '" + path + "'!");
+    }
+    length = size_t(file_size.QuadPart);
+    if (length > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        bytes = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        if (!bytes) {
+            throw std::runtime_error("Failed to map '" + path + "'!");
+        }
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Failed to open '" + path + "'!");
+    }
+    length = size_t(file_stat.st_size);
+    if (length > 0) {
+        void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map '" + path + "'!");
+        }
+        // Every thread parses its own part of the file, start reading all of it right away
+        madvise(address, length, MADV_WILLNEED);
+        bytes = static_cast<const char *>(address);
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (bytes) {
+        UnmapViewOfFile(bytes);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file && file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+#else
+    if (bytes) {
+        munmap(const_cast<char *>(bytes), length);
+    }
+#endif
+}
+
+static void computeNormal(const MeshVertex &a, const MeshVertex &b, const MeshVertex &c, float normal[3])
+{
+    float u[3], v[3];
+    for (int k = 0; k < 3; k++) {
+        u[k] = b.position[k] - a.position[k];
+        v[k] = c.position[k] - a.position[k];
+    }
+    // Not normalized, so larger triangles weigh more in the vertex normals
+    normal[0] = u[1] * v[2] - u[2] * v[1];
+    normal[1] = u[2] * v[0] - u[0] * v[2];
+    normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static void normalize(float v[3])
+{
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+// Area weighted smooth normals for the vertices whose flag is set
+static void computeMissingNormals(MeshData &mesh, const std::vector<uint8_t> &missing)
+{
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        if (missing[i]) {
+            std::fill(std::begin(mesh.vertices[i].normal), std::end(mesh.vertices[i].normal), 0.0f);
+        }
+    }
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        float normal[3];
+        computeNormal(mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]], normal);
+        for (size_t j = i; j < i + 3; j++) {
+            if (missing[mesh.indices[j]]) {
+                for (int k = 0; k < 3; k++) {
+                    mesh.vertices[mesh.indices[j]].normal[k] += normal[k];
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        if (missing[i]) {
+            normalize(mesh.vertices[i].normal);
+        }
+    }
+}
+
+//
+// Wavefront OBJ
+//
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *parseFloat(const char *p, const char *end, float &result)
+{
+    p = skipSpaces(p, end);
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+
+    double value = 0.0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10.0 + (*p++ - '0');
+    }
+    if (p < end && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value += (*p++ - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        int exponent = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            exponent = exponent * 10 + (*p++ - '0');
+        }
+        value *= std::pow(10.0, negative_exponent ? -exponent : exponent);
+    }
+
+    result = float(negative ? -value : value);
+    return p;
+}
+
+// Face indices are 1-based and absolute, or negative and relative to the elements defined so far. A chunk does not
+// know how many elements precede it, so relative indices are kept relative to the chunk until the chunks are merged.
+static const int32_t obj_missing = -1;
+static const int32_t obj_local_bias = 1 << 30;
+// Largest index magnitude whose encoding neither wraps nor collides with the other range
+static const long obj_max_index = obj_local_bias;
+
+static const char *parseIndex(const char *p, const char *end, long &result)
+{
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+        if (value > obj_max_index) {
+            throw std::runtime_error("OBJ face index out of range!");
+        }
+    }
+    result = negative ? -value : value;
+    return p;
+}
+
+static int32_t encodeObjIndex(long value, size_t local_count)
+{
+    if (value > 0) {
+        return int32_t(value - 1);
+    }
+    if (value < 0) {
+        return int32_t(long(local_count) + value - obj_local_bias);
+    }
+    return obj_missing;
+}
+
+static int64_t decodeObjIndex(int32_t encoded, size_t base)
+{
+    if (encoded >= 0 || encoded == obj_missing) {
+        return encoded;
+    }
+    return int64_t(base) + int64_t(encoded) + obj_local_bias;
+}
+
+struct ObjChunk {
+    std::vector<float> positions; // xyz
+    std::vector<float> texcoords; // uv
+    std::vector<float> normals;   // xyz
+    std::vector<int32_t> corners; // position, texcoord and normal index of every triangle corner
+};
+
+static const char *parseObjCorner(const char *p, const char *end, const ObjChunk &chunk, int32_t corner[3])
+{
+    long value;
+    const char *start = p;
+    p = parseIndex(p, end, value);
+    // Every corner starts with a position index, a token without one would never be consumed
+    if (p == start || p[-1] < '0' || p[-1] > '9') {
+        throw std::runtime_error("Malformed OBJ face!");
+    }
+    corner[0] = encodeObjIndex(value, chunk.positions.size() / 3);
+    corner[1] = corner[2] = obj_missing;
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            p = parseIndex(p, end, value);
+            corner[1] = encodeObjIndex(value, chunk.texcoords.size() / 2);
+        }
+        if (p < end && *p == '/') {
+            p = parseIndex(p + 1, end, value);
+            corner[2] = encodeObjIndex(value, chunk.normals.size() / 3);
+        }
+    }
+    return p;
+}
+
+static void parseObjChunk(const char *p, const char *end, ObjChunk &chunk)
+{
+    while (p < end) {
+        p = skipSpaces(p, end);
+        const char *line_end = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        if (!line_end) {
+            line_end = end;
+        }
+
+        if (line_end - p >= 2 && p[0] == 'v' && isSpace(p[1])) {
+            float x, y, z;
+            p = parseFloat(parseFloat(parseFloat(p + 2, line_end, x), line_end, y), line_end, z);
+            chunk.positions.insert(chunk.positions.end(), {x, y, z});
+        } else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+            float u, v;
+            p = parseFloat(parseFloat(p + 3, line_end, u), line_end, v);
+            // OBJ puts the texture origin at the bottom left, glTF and Vulkan at the top left
+            chunk.texcoords.insert(chunk.texcoords.end(), {u, 1.0f - v});
+        } else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+            float x, y, z;
+            p = parseFloat(parseFloat(parseFloat(p + 3, line_end, x), line_end, y), line_end, z);
+            chunk.normals.insert(chunk.normals.end(), {x, y, z});
+        } else if (line_end - p >= 2 && p[0] == 'f' && isSpace(p[1])) {
+            // Polygons are triangulated as fans around their first corner
+            int32_t first[3], previous[3], current[3];
+            int corner_count = 0;
+            p = skipSpaces(p + 2, line_end);
+            while (p < line_end && *p != '#') {
+                p = skipSpaces(parseObjCorner(p, line_end, chunk, current), line_end);
+                if (corner_count == 0) {
+                    std::copy(current, current + 3, first);
+                } else if (corner_count >= 2) {
+                    chunk.corners.insert(chunk.corners.end(), first, first + 3);
+                    chunk.corners.insert(chunk.corners.end(), previous, previous + 3);
+                    chunk.corners.insert(chunk.corners.end(), current, current + 3);
+                }
+                std::copy(current, current + 3, previous);
+                corner_count++;
+            }
+        }
+
+        p = line_end < end ? line_end + 1 : end;
+    }
+}
+
+// Open addressing hash table from (position, texcoord, normal) to a vertex index, kept at most half full
+class CornerTable
+{
+  public:
+    // The capacity is an estimate, flat shaded meshes have many more unique corners than positions
+    explicit CornerTable(size_t capacity)
+    {
+        size_t size = 16;
+        while (size < capacity * 2) {
+            size *= 2;
+        }
+        slots.assign(size, empty);
+    }
+
+    // Index of an equal corner inserted before, or of the new corner
+    uint32_t insert(const uint32_t *corners, uint32_t corner, uint32_t vertex_index, std::vector<uint32_t> &vertex_corners)
+    {
+        if ((vertex_corners.size() + 1) * 2 > slots.size()) {
+            grow(corners, vertex_corners);
+        }
+        const uint32_t *key = corners + size_t(corner) * 3;
+        size_t mask = slots.size() - 1;
+        size_t slot = hash(key) & mask;
+        while (slots[slot] != empty) {
+            const uint32_t *other = corners + size_t(vertex_corners[slots[slot]]) * 3;
+            if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) {
+                return slots[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = vertex_index;
+        vertex_corners.push_back(corner);
+        return vertex_index;
+    }
+
+  private:
+    static constexpr uint32_t empty = UINT32_MAX;
+    std::vector<uint32_t> slots;
+
+    // Every vertex is a distinct corner, so they are rehashed without comparing keys
+    void grow(const uint32_t *corners, const std::vector<uint32_t> &vertex_corners)
+    {
+        slots.assign(slots.size() * 2, empty);
+        size_t mask = slots.size() - 1;
+        for (size_t vertex = 0; vertex < vertex_corners.size(); vertex++) {
+            size_t slot = hash(corners + size_t(vertex_corners[vertex]) * 3) & mask;
+            while (slots[slot] != empty) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = uint32_t(vertex);
+        }
+    }
+
+    static size_t hash(const uint32_t *key)
+    {
+        uint64_t h = key[0] * 0x9e3779b97f4a7c15ull;
+        h ^= (key[1] + 0x632be59bd9b4e019ull) * 0xc2b2ae3d27d4eb4full;
+        h ^= (key[2] + 0x165667b19e3779f9ull) * 0x94d049bb133111ebull;
+        return size_t(h ^ (h >> 29));
+    }
+};
+
+static MeshData parseObj(const char *begin, const char *end, JobSystem &jobs)
+{
+    size_t size = size_t(end - begin);
+
+    // Chunks start at line boundaries, a few per thread since their content is not evenly distributed
+    size_t chunk_count = std::max(std::min(size_t(jobs.threadCount()) * 4, size / (1 << 16)), size_t(1));
+    auto chunk_starts = std::vector<const char *>{begin};
+    for (size_t c = 1; c < chunk_count; c++) {
+        const char *p = std::max(begin + size * c / chunk_count, chunk_starts.back());
+        const char *line_end = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        chunk_starts.push_back(line_end ? line_end + 1 : end);
+    }
+    chunk_starts.push_back(end);
+
+    auto chunks = std::vector<ObjChunk>(chunk_count);
+    jobs.parallelFor(chunk_count, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++) {
+            parseObjChunk(chunk_starts[c], chunk_starts[c + 1], chunks[c]);
+        }
+    });
+
+    // Offsets of each chunk's elements in the merged arrays
+    struct ChunkBase {
+        size_t positions, texcoords, normals, corners;
+    };
+    auto bases = std::vector<ChunkBase>(chunk_count + 1, ChunkBase{0, 0, 0, 0});
+    for (size_t c = 0; c < chunk_count; c++) {
+        bases[c + 1].positions = bases[c].positions + chunks[c].positions.size() / 3;
+        bases[c + 1].texcoords = bases[c].texcoords + chunks[c].texcoords.size() / 2;
+        bases[c + 1].normals = bases[c].normals + chunks[c].normals.size() / 3;
+        bases[c + 1].corners = bases[c].corners + chunks[c].corners.size() / 3;
+    }
+    const auto &totals = bases[chunk_count];
+    if (totals.corners == 0) {
+        throw std::runtime_error("OBJ file contains no faces!");
+    }
+    if (totals.corners > UINT32_MAX) {
+        throw std::runtime_error("OBJ file has too many faces!");
+    }
+
+    auto positions = std::vector<float>(totals.positions * 3);
+    auto texcoords = std::vector<float>(totals.texcoords * 2);
+    auto normals = std::vector<float>(totals.normals * 3);
+    auto corners = std::vector<uint32_t>(totals.corners * 3);
+
+    auto resolve = [](int32_t encoded, size_t base, size_t count) {
+        int64_t index = decodeObjIndex(encoded, base);
+        if (encoded == obj_missing) {
+            return UINT32_MAX;
+        }
+        if (index < 0 || size_t(index) >= count) {
+            throw std::runtime_error("OBJ face index out of range!");
+        }
+        return uint32_t(index);
+    };
+
+    jobs.parallelFor(chunk_count, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++) {
+            const auto &chunk = chunks[c];
+            std::copy(chunk.positions.cbegin(), chunk.positions.cend(), positions.begin() + bases[c].positions * 3);
+            std::copy(chunk.texcoords.cbegin(), chunk.texcoords.cend(), texcoords.begin() + bases[c].texcoords * 2);
+            std::copy(chunk.normals.cbegin(), chunk.normals.cend(), normals.begin() + bases[c].normals * 3);
+            for (size_t i = 0; i < chunk.corners.size(); i += 3) {
+                uint32_t *corner = corners.data() + bases[c].corners * 3 + i;
+                corner[0] = resolve(chunk.corners[i], bases[c].positions, totals.positions);
+                corner[1] = resolve(chunk.corners[i + 1], bases[c].texcoords, totals.texcoords);
+                corner[2] = resolve(chunk.corners[i + 2], bases[c].normals, totals.normals);
+                if (corner[0] == UINT32_MAX) {
+                    throw std::runtime_error("OBJ face without position index!");
+                }
+            }
+        }
+    });
+    chunks.clear();
+
+    // Corners with the same position, texcoord and normal become one vertex
+    auto mesh = MeshData();
+    mesh.indices.resize(totals.corners);
+    auto vertex_corners = std::vector<uint32_t>();
+    auto table = CornerTable(std::min(totals.corners, totals.positions * 2));
+    for (uint32_t corner = 0; corner < totals.corners; corner++) {
+        mesh.indices[corner] = table.insert(corners.data(), corner, uint32_t(vertex_corners.size()), vertex_corners);
+    }
+
+    mesh.vertices.resize(vertex_corners.size());
+    auto missing_normals = std::vector<uint8_t>(vertex_corners.size());
+    jobs.parallelFor(vertex_corners.size(), 4096, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            const uint32_t *corner = corners.data() + size_t(vertex_corners[i]) * 3;
+            auto &vertex = mesh.vertices[i];
+            std::copy_n(positions.data() + size_t(corner[0]) * 3, 3, vertex.position);
+            if (corner[1] != UINT32_MAX) {
+                std::copy_n(texcoords.data() + size_t(corner[1]) * 2, 2, vertex.texcoord);
+            } else {
+                vertex.texcoord[0] = vertex.texcoord[1] = 0.0f;
+            }
+            if (corner[2] != UINT32_MAX) {
+                std::copy_n(normals.data() + size_t(corner[2]) * 3, 3, vertex.normal);
+            } else {
+                missing_normals[i] = 1;
+            }
+        }
+    });
+
+    if (std::find(missing_normals.cbegin(), missing_normals.cend(), 1) != missing_normals.cend()) {
+        computeMissingNormals(mesh, missing_normals);
+    }
+    return mesh;
+}
+
+MeshData loadObj(const MappedFile &file, JobSystem &jobs)
+{
+    return parseObj(file.data(), file.data() + file.size(), jobs);
+}
+
+// Grid of size x size quads split into triangles. Flat shaded, every triangle has a normal of its own so that no two
+// corners share a vertex, otherwise all of them use the same normal.
+static std::string gridObj(unsigned int size, bool flat)
+{
+    auto source = std::string();
+    for (unsigned int y = 0; y <= size; y++) {
+        for (unsigned int x = 0; x <= size; x++) {
+            source += "v " + std::to_string(x) + " " + std::to_string(y) + " 0\n";
+        }
+    }
+    unsigned int normal = 0;
+    auto corner = [&](unsigned int position) { return std::to_string(position) + "//" + std::to_string(normal); };
+    for (unsigned int y = 0; y < size; y++) {
+        for (unsigned int x = 0; x < size; x++) {
+            unsigned int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+            for (const auto &triangle : {std::array<unsigned int, 3>{a, c, d}, std::array<unsigned int, 3>{a, d, b}}) {
+                if (flat || normal == 0) {
+                    source += "vn 0 0 1\n";
+                    normal++;
+                }
+                source += "f " + corner(triangle[0]) + " " + corner(triangle[1]) + " " + corner(triangle[2]) + "\n";
+            }
+        }
+    }
+    return source;
+}
+
+bool checkObjLoader(JobSystem &jobs)
+{
+    struct Check {
+        const char *name;
+        std::string source;
+        size_t vertex_count; // 0: loading is expected to throw
+    };
+    const Check checks[] = {
+        {"smooth shaded grid", gridObj(40, false), 41 * 41},
+        {"flat shaded grid", gridObj(40, true), 40 * 40 * 2 * 3},
+        {"quad", "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n", 4},
+        {"relative indices", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf -3 -2 -1\n", 3},
+        {"face without index", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf / 1 2\n", 0},
+        {"index out of range", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n", 0},
+        {"huge index", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4294967299\n", 0},
+        {"huge relative index", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 -99999999999999999999999\n", 0},
+        {"no faces", "v 0 0 0\n", 0},
+    };
+
+    bool passed = true;
+    for (const auto &check : checks) {
+        auto result = std::string();
+        try {
+            auto mesh = parseObj(check.source.data(), check.source.data() + check.source.size(), jobs);
+            if (mesh.vertices.size() != check.vertex_count) {
+                result = "loaded " + std::to_string(mesh.vertices.size()) + " vertices, expected " +
+                         (check.vertex_count > 0 ? std::to_string(check.vertex_count) : std::string("an error"));
+            }
+        } catch (const std::exception &e) {
+            if (check.vertex_count > 0) {
+                result = std::string("failed: ") + e.what();
+            }
+        }
+        std::cout << "OBJ loader check '" << check.name << "': " << (result.empty() ? "ok" : result) << std::endl;
+        passed = passed && result.empty();
+    }
+    return passed;
+}
+
+//
+// glTF 2.0
+//
+
+// Minimal JSON document model, enough for the glTF structure
+struct JsonValue {
+    enum Type {
+        eNull,
+        eBool,
+        eNumber,
+        eString,
+        eArray,
+        eObject
+    };
+
+    Type type = eNull;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue *find(const char *key) const
+    {
+        for (const auto &member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    double numberOr(const char *key, double fallback) const
+    {
+        auto value = find(key);
+        return value && value->type == eNumber ? value->number : fallback;
+    }
+
+    size_t size() const { return type == eArray ? array.size() : 0; }
+};
+
+class JsonParser
+{
+  public:
+    JsonParser(const char *begin, const char *end) : p(begin), end(end) {}
+
+    JsonValue parseDocument()
+    {
+        auto value = parseValue(0);
+        skipWhitespace();
+        if (p != end) {
+            fail();
+        }
+        return value;
+    }
+
+  private:
+    const char *p;
+    const char *end;
+
+    [[noreturn]] void fail() { throw std::runtime_error("Malformed glTF JSON!"); }
+
+    void skipWhitespace()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    void expect(char c)
+    {
+        skipWhitespace();
+        if (p == end || *p != c) {
+            fail();
+        }
+        p++;
+    }
+
+    bool consume(const char *literal)
+    {
+        size_t length = std::strlen(literal);
+        if (size_t(end - p) >= length && std::memcmp(p, literal, length) == 0) {
+            p += length;
+            return true;
+        }
+        return false;
+    }
+
+    JsonValue parseValue(int depth)
+    {
+        if (depth > 64) {
+            fail();
+        }
+        skipWhitespace();
+        if (p == end) {
+            fail();
+        }
+
+        auto value = JsonValue();
+        if (*p == '{') {
+            p++;
+            value.type = JsonValue::eObject;
+            skipWhitespace();
+            if (p < end && *p == '}') {
+                p++;
+                return value;
+            }
+            do {
+                skipWhitespace();
+                auto key = parseString();
+                expect(':');
+                value.object.emplace_back(std::move(key), parseValue(depth + 1));
+                skipWhitespace();
+            } while (p < end && *p == ',' && ++p);
+            expect('}');
+        } else if (*p == '[') {
+            p++;
+            value.type = JsonValue::eArray;
+            skipWhitespace();
+            if (p < end && *p == ']') {
+                p++;
+                return value;
+            }
+            do {
+                value.array.push_back(parseValue(depth + 1));
+                skipWhitespace();
+            } while (p < end && *p == ',' && ++p);
+            expect(']');
+        } else if (*p == '"') {
+            value.type = JsonValue::eString;
+            value.string = parseString();
+        } else if (consume("true")) {
+            value.type = JsonValue::eBool;
+            value.boolean = true;
+        } else if (consume("false")) {
+            value.type = JsonValue::eBool;
+        } else if (consume("null")) {
+            value.type = JsonValue::eNull;
+        } else {
+            const char *start = p;
+            while (p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) {
+                p++;
+            }
+            auto text = std::string(start, p);
+            char *number_end = nullptr;
+            value.type = JsonValue::eNumber;
+            value.number = std::strtod(text.c_str(), &number_end);
+            if (text.empty() || number_end != text.c_str() + text.size()) {
+                fail();
+            }
+        }
+        return value;
+    }
+
+    std::string parseString()
+    {
+        if (p == end || *p != '"') {
+            fail();
+        }
+        p++;
+        auto result = std::string();
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                result += *p++;
+                continue;
+            }
+            if (++p == end) {
+                fail();
+            }
+            switch (*p++) {
+            case 'b':
+                result += '\b';
+                break;
+            case 'f':
+                result += '\f';
+                break;
+            case 'n':
+                result += '\n';
+                break;
+            case 'r':
+                result += '\r';
+                break;
+            case 't':
+                result += '\t';
+                break;
+            case 'u': {
+                if (end - p < 4) {
+                    fail();
+                }
+                unsigned int code = std::stoul(std::string(p, p + 4), nullptr, 16);
+                p += 4;
+                // Names are only compared, surrogate pairs are kept as two code points
+                if (code < 0x80) {
+                    result += char(code);
+                } else if (code < 0x800) {
+                    result += char(0xc0 | (code >> 6));
+                    result += char(0x80 | (code & 0x3f));
+                } else {
+                    result += char(0xe0 | (code >> 12));
+                    result += char(0x80 | ((code >> 6) & 0x3f));
+                    result += char(0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default:
+                result += p[-1];
+                break;
+            }
+        }
+        if (p == end) {
+            fail();
+        }
+        p++;
+        return result;
+    }
+};
+
+static std::vector<char> decodeBase64(const char *p, const char *end)
+{
+    auto result = std::vector<char>();
+    result.reserve(size_t(end - p) / 4 * 3);
+    uint32_t bits = 0;
+    int bit_count = 0;
+    for (; p < end && *p != '='; p++) {
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const char *found = std::strchr(alphabet, *p);
+        if (!found || *p == '\0') {
+            throw std::runtime_error("Malformed base64 buffer in glTF file!");
+        }
+        bits = (bits << 6) | uint32_t(found - alphabet);
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            result.push_back(char((bits >> bit_count) & 0xff));
+        }
+    }
+    return result;
+}
+
+struct GltfAccessor {
+    const char *data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int component_type = 0;
+    int component_count = 0;
+    bool normalized = false;
+
+    float readFloat(size_t index, int component) const
+    {
+        const char *element = data + index * stride;
+        switch (component_type) {
+        case 5126: { // FLOAT
+            float value;
+            std::memcpy(&value, element + component * 4, 4);
+            return value;
+        }
+        case 5121: // UNSIGNED_BYTE
+            return float(reinterpret_cast<const uint8_t *>(element)[component]) / (normalized ? 255.0f : 1.0f);
+        case 5120: // BYTE
+            return normalized ? std::max(float(reinterpret_cast<const int8_t *>(element)[component]) / 127.0f, -1.0f)
+                              : float(reinterpret_cast<const int8_t *>(element)[component]);
+        case 5123: { // UNSIGNED_SHORT
+            uint16_t value;
+            std::memcpy(&value, element + component * 2, 2);
+            return float(value) / (normalized ? 65535.0f : 1.0f);
+        }
+        case 5122: { // SHORT
+            int16_t value;
+            std::memcpy(&value, element + component * 2, 2);
+            return normalized ? std::max(float(value) / 32767.0f, -1.0f) : float(value);
+        }
+        }
+        throw std::runtime_error("Unsupported glTF accessor component type!");
+    }
+
+    uint32_t readIndex(size_t index) const
+    {
+        const char *element = data + index * stride;
+        switch (component_type) {
+        case 5121:
+            return *reinterpret_cast<const uint8_t *>(element);
+        case 5123: {
+            uint16_t value;
+            std::memcpy(&value, element, 2);
+            return value;
+        }
+        case 5125: {
+            uint32_t value;
+            std::memcpy(&value, element, 4);
+            return value;
+        }
+        }
+        throw std::runtime_error("Unsupported glTF index component type!");
+    }
+};
+
+class GltfDocument
+{
+  public:
+    explicit GltfDocument(const std::string &path) : file(path)
+    {
+        const char *json_begin = file.data();
+        const char *json_end = file.data() + file.size();
+
+        // Binary glTF: 12 byte header, then a JSON chunk and an optional BIN chunk
+        if (file.size() >= 12 && std::memcmp(file.data(), "glTF", 4) == 0) {
+            auto read32 = [&](size_t offset) {
+                uint32_t value;
+                if (offset + 4 > file.size()) {
+                    throw std::runtime_error("Truncated glb file!");
+                }
+                std::memcpy(&value, file.data() + offset, 4);
+                return value;
+            };
+            size_t offset = 12;
+            uint32_t json_length = read32(offset);
+            if (read32(offset + 4) != 0x4e4f534a || offset + 8 + json_length > file.size()) { // "JSON"
+                throw std::runtime_error("Malformed glb file!");
+            }
+            json_begin = file.data() + offset + 8;
+            json_end = json_begin + json_length;
+            offset += 8 + json_length;
+            if (offset + 8 <= file.size() && read32(offset + 4) == 0x004e4942) { // "BIN\0"
+                uint32_t bin_length = read32(offset);
+                if (offset + 8 + bin_length > file.size()) {
+                    throw std::runtime_error("Malformed glb file!");
+                }
+                binary_chunk = {file.data() + offset + 8, bin_length};
+            }
+        }
+
+        root = JsonParser(json_begin, json_end).parseDocument();
+        loadBuffers(std::filesystem::path(path).parent_path());
+    }
+
+    const JsonValue &json() const { return root; }
+
+    const JsonValue &element(const char *collection, double index) const
+    {
+        auto array = root.find(collection);
+        if (!array || index < 0 || size_t(index) >= array->size()) {
+            throw std::runtime_error(std::string("glTF reference into '") + collection + "' out of range!");
+        }
+        return array->array[size_t(index)];
+    }
+
+    GltfAccessor accessor(double index) const
+    {
+        const auto &json = element("accessors", index);
+        if (json.find("sparse")) {
+            throw std::runtime_error("Sparse glTF accessors are not supported!");
+        }
+        auto buffer_view_index = json.find("bufferView");
+        if (!buffer_view_index) {
+            throw std::runtime_error("glTF accessors without buffer view are not supported!");
+        }
+        const auto &buffer_view = element("bufferViews", buffer_view_index->number);
+        const auto &buffer = buffers.at(size_t(buffer_view.numberOr("buffer", 0)));
+
+        auto accessor = GltfAccessor();
+        accessor.count = size_t(json.numberOr("count", 0));
+        accessor.component_type = int(json.numberOr("componentType", 0));
+        auto normalized = json.find("normalized");
+        accessor.normalized = normalized && normalized->boolean;
+
+        auto type = json.find("type");
+        const std::pair<const char *, int> types[] = {{"SCALAR", 1}, {"VEC2", 2}, {"VEC3", 3}, {"VEC4", 4}};
+        for (const auto &candidate : types) {
+            if (type && type->string == candidate.first) {
+                accessor.component_count = candidate.second;
+            }
+        }
+        size_t component_size = accessor.component_type == 5126 || accessor.component_type == 5125 ? 4
+                                : accessor.component_type == 5122 || accessor.component_type == 5123 ? 2 : 1;
+        size_t element_size = component_size * size_t(accessor.component_count);
+        accessor.stride = size_t(buffer_view.numberOr("byteStride", double(element_size)));
+
+        size_t view_offset = size_t(buffer_view.numberOr("byteOffset", 0));
+        size_t view_length = size_t(buffer_view.numberOr("byteLength", 0));
+        size_t offset = size_t(json.numberOr("byteOffset", 0));
+        if (accessor.component_count == 0 || view_offset + view_length > buffer.second ||
+            (accessor.count > 0 && offset + accessor.stride * (accessor.count - 1) + element_size > view_length)) {
+            throw std::runtime_error("glTF accessor out of bounds!");
+        }
+        accessor.data = buffer.first + view_offset + offset;
+        return accessor;
+    }
+
+  private:
+    MappedFile file;
+    JsonValue root;
+    std::pair<const char *, size_t> binary_chunk{nullptr, 0};
+    std::vector<std::unique_ptr<MappedFile>> external_buffers;
+    std::vector<std::vector<char>> embedded_buffers;
+    std::vector<std::pair<const char *, size_t>> buffers;
+
+    void loadBuffers(const std::filesystem::path &directory)
+    {
+        auto json_buffers = root.find("buffers");
+        for (size_t i = 0; json_buffers && i < json_buffers->size(); i++) {
+            const auto &buffer = json_buffers->array[i];
+            auto uri = buffer.find("uri");
+            if (!uri) {
+                if (!binary_chunk.first) {
+                    throw std::runtime_error("glTF buffer without uri outside of a glb file!");
+                }
+                buffers.push_back(binary_chunk);
+            } else if (uri->string.compare(0, 5, "data:") == 0) {
+                auto comma = uri->string.find(";base64,");
+                if (comma == std::string::npos) {
+                    throw std::runtime_error("Unsupported glTF data uri!");
+                }
+                const char *encoded = uri->string.c_str() + comma + 8;
+                embedded_buffers.push_back(decodeBase64(encoded, uri->string.c_str() + uri->string.size()));
+                buffers.emplace_back(embedded_buffers.back().data(), embedded_buffers.back().size());
+            } else {
+                external_buffers.push_back(std::make_unique<MappedFile>((directory / uri->string).string()));
+                buffers.emplace_back(external_buffers.back()->data(), external_buffers.back()->size());
+            }
+
+            // Never trust byteLength over the actual data size
+            buffers.back().second = std::min(buffers.back().second, size_t(buffer.numberOr("byteLength", 0)));
+        }
+    }
+};
+
+// Column-major 4x4 matrix
+using GltfMatrix = std::array<float, 16>;
+
+static GltfMatrix multiply(const GltfMatrix &a, const GltfMatrix &b)
+{
+    auto result = GltfMatrix();
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            result[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+static GltfMatrix nodeMatrix(const JsonValue &node)
+{
+    auto matrix = GltfMatrix{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    auto read = [&](const char *key, float *values, size_t count) {
+        auto array = node.find(key);
+        for (size_t i = 0; array && i < count && i < array->size(); i++) {
+            values[i] = float(array->array[i].number);
+        }
+        return array != nullptr;
+    };
+
+    if (read("matrix", matrix.data(), 16)) {
+        return matrix;
+    }
+
+    float translation[3] = {0, 0, 0}, rotation[4] = {0, 0, 0, 1}, scale[3] = {1, 1, 1};
+    read("translation", translation, 3);
+    read("rotation", rotation, 4);
+    read("scale", scale, 3);
+
+    // T * R * S, with R from the unit quaternion (x, y, z, w)
+    float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+    float r[9] = {
+        1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+        2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+        2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y)};
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            matrix[column * 4 + row] = r[column * 3 + row] * scale[column];
+        }
+        matrix[12 + column] = translation[column];
+    }
+    return matrix;
+}
+
+struct GltfPrimitive {
+    const JsonValue *json;
+    GltfMatrix transform;
+    size_t vertex_count;
+    size_t index_count;
+    size_t first_vertex;
+    size_t first_index;
+};
+
+static void collectPrimitives(const GltfDocument &document, double node_index, const GltfMatrix &parent,
+                              std::vector<GltfPrimitive> &primitives, int depth)
+{
+    if (depth > 64) {
+        throw std::runtime_error("glTF node hierarchy too deep!");
+    }
+    const auto &node = document.element("nodes", node_index);
+    auto transform = multiply(parent, nodeMatrix(node));
+
+    if (auto mesh_index = node.find("mesh")) {
+        auto json_primitives = document.element("meshes", mesh_index->number).find("primitives");
+        for (size_t i = 0; json_primitives && i < json_primitives->size(); i++) {
+            const auto &primitive = json_primitives->array[i];
+            auto attributes = primitive.find("attributes");
+            // Only triangle lists (mode 4, the default) end up in the mesh
+            if (primitive.numberOr("mode", 4) != 4 || !attributes || !attributes->find("POSITION")) {
+                continue;
+            }
+            primitives.push_back({&primitive, transform, 0, 0, 0, 0});
+        }
+    }
+
+    if (auto children = node.find("children")) {
+        for (const auto &child : children->array) {
+            collectPrimitives(document, child.number, transform, primitives, depth + 1);
+        }
+    }
+}
+
+MeshData loadGltf(const std::string &path, JobSystem &jobs)
+{
+    auto document = GltfDocument(path);
+    const auto &root = document.json();
+
+    auto primitives = std::vector<GltfPrimitive>();
+    const auto identity = GltfMatrix{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    auto scenes = root.find("scenes");
+    if (scenes && scenes->size() > 0) {
+        auto nodes = document.element("scenes", root.numberOr("scene", 0)).find("nodes");
+        for (size_t i = 0; nodes && i < nodes->size(); i++) {
+            collectPrimitives(document, nodes->array[i].number, identity, primitives, 0);
+        }
+    } else if (auto meshes = root.find("meshes")) {
+        // No scene: every mesh once, untransformed
+        for (const auto &mesh : meshes->array) {
+            auto json_primitives = mesh.find("primitives");
+            for (size_t i = 0; json_primitives && i < json_primitives->size(); i++) {
+                auto attributes = json_primitives->array[i].find("attributes");
+                if (json_primitives->array[i].numberOr("mode", 4) == 4 && attributes && attributes->find("POSITION")) {
+                    primitives.push_back({&json_primitives->array[i], identity, 0, 0, 0, 0});
+                }
+            }
+        }
+    }
+
+    size_t vertex_count = 0, index_count = 0;
+    for (auto &primitive : primitives) {
+        primitive.vertex_count = document.accessor(primitive.json->find("attributes")->find("POSITION")->number).count;
+        auto indices = primitive.json->find("indices");
+        primitive.index_count = indices ? document.accessor(indices->number).count : primitive.vertex_count;
+        primitive.index_count -= primitive.index_count % 3;
+        primitive.first_vertex = vertex_count;
+        primitive.first_index = index_count;
+        vertex_count += primitive.vertex_count;
+        index_count += primitive.index_count;
+    }
+    if (index_count == 0) {
+        throw std::runtime_error("glTF file contains no triangles!");
+    }
+    if (vertex_count > UINT32_MAX) {
+        throw std::runtime_error("glTF file has too many vertices!");
+    }
+
+    auto mesh = MeshData();
+    mesh.vertices.resize(vertex_count);
+    mesh.indices.resize(index_count);
+    auto missing_normals = std::vector<uint8_t>();
+
+    // Primitives are decoded one after the other, each one split across all threads
+    for (const auto &primitive : primitives) {
+        const auto &attributes = *primitive.json->find("attributes");
+        auto positions = document.accessor(attributes.find("POSITION")->number);
+        auto normal_index = attributes.find("NORMAL");
+        auto texcoord_index = attributes.find("TEXCOORD_0");
+        auto normals = normal_index ? document.accessor(normal_index->number) : GltfAccessor();
+        auto texcoords = texcoord_index ? document.accessor(texcoord_index->number) : GltfAccessor();
+        if (positions.component_count < 3 || (normal_index && (normals.component_count < 3 || normals.count < positions.count)) ||
+            (texcoord_index && (texcoords.component_count < 2 || texcoords.count < positions.count))) {
+            throw std::runtime_error("Unexpected glTF vertex attribute layout!");
+        }
+
+        // Normals transform with the inverse transpose, here the cofactor matrix (stored column-major) since they are
+        // renormalized anyway. The cofactor matrix is the inverse transpose times the determinant, hence the sign.
+        const auto &m = primitive.transform;
+        float cofactor[9] = {
+            m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+            m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+            m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]};
+        float determinant = m[0] * cofactor[0] + m[1] * cofactor[1] + m[2] * cofactor[2];
+        float normal_sign = determinant < 0.0f ? -1.0f : 1.0f;
+
+        jobs.parallelFor(primitive.vertex_count, 4096, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                auto &vertex = mesh.vertices[primitive.first_vertex + i];
+                float p[3] = {positions.readFloat(i, 0), positions.readFloat(i, 1), positions.readFloat(i, 2)};
+                for (int row = 0; row < 3; row++) {
+                    vertex.position[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+                }
+                if (normal_index) {
+                    float n[3] = {normals.readFloat(i, 0), normals.readFloat(i, 1), normals.readFloat(i, 2)};
+                    for (int row = 0; row < 3; row++) {
+                        vertex.normal[row] = normal_sign * (cofactor[row] * n[0] + cofactor[3 + row] * n[1] + cofactor[6 + row] * n[2]);
+                    }
+                    normalize(vertex.normal);
+                }
+                vertex.texcoord[0] = texcoord_index ? texcoords.readFloat(i, 0) : 0.0f;
+                vertex.texcoord[1] = texcoord_index ? texcoords.readFloat(i, 1) : 0.0f;
+            }
+        });
+
+        auto indices_index = primitive.json->find("indices");
+        auto indices = indices_index ? document.accessor(indices_index->number) : GltfAccessor();
+        jobs.parallelFor(primitive.index_count / 3, 4096, [&](size_t first, size_t last) {
+            for (size_t t = first; t < last; t++) {
+                uint32_t triangle[3];
+                for (size_t k = 0; k < 3; k++) {
+                    triangle[k] = indices_index ? indices.readIndex(t * 3 + k) : uint32_t(t * 3 + k);
+                    if (triangle[k] >= primitive.vertex_count) {
+                        throw std::runtime_error("glTF index out of range!");
+                    }
+                }
+                // A mirroring transform flips the winding
+                if (determinant < 0.0f) {
+                    std::swap(triangle[1], triangle[2]);
+                }
+                for (size_t k = 0; k < 3; k++) {
+                    mesh.indices[primitive.first_index + t * 3 + k] = uint32_t(primitive.first_vertex) + triangle[k];
+                }
+            }
+        });
+
+        if (!normal_index) {
+            missing_normals.resize(vertex_count);
+            std::fill_n(missing_normals.begin() + primitive.first_vertex, primitive.vertex_count, uint8_t(1));
+        }
+    }
+
+    if (!missing_normals.empty()) {
+        computeMissingNormals(mesh, missing_normals);
+    }
+    return mesh;
+}
+
+MeshData loadMesh(const std::string &path, JobSystem &jobs)
+{
+    auto extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+    if (extension == ".obj") {
+        return loadObj(MappedFile(path), jobs);
+    }
+    if (extension == ".gltf" || extension == ".glb") {
+        return loadGltf(path, jobs);
+    }
+    throw std::runtime_error("Unsupported mesh format '" + extension + "'!");
+}
@@ -0,0 +1,205 @@
+#include "particles.hpp"
+
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// The AVX kernel is compiled for AVX on its own and only called when the CPU supports it, the rest of the
+// build keeps its baseline instruction set
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PARTICLES_AVX
+#define AVX_TARGET __attribute__((target("avx")))
+static bool cpuSupportsAvx()
+{
+    return __builtin_cpu_supports("avx");
+}
+#elif defined(_M_X64)
+#include <intrin.h>
+#define PARTICLES_AVX
+#define AVX_TARGET
+static bool cpuSupportsAvx()
+{
+    // CPU support, and the OS saving the YMM registers
+    int info[4];
+    __cpuid(info, 1);
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    return avx && osxsave && (_xgetbv(0) & 6) == 6;
+}
+#endif
+
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float uniform(uint32_t seed)
+{
+    return float(hash(seed) >> 8) / float(1u << 24);
+}
+
+std::vector<Particle> initialParticles(size_t count, float stiffness)
+{
+    const float two_pi = 6.2831853f;
+    auto particles = std::vector<Particle>(count);
+    for (size_t i = 0; i < count; i++) {
+        float radius = 0.9f * std::sqrt(uniform(uint32_t(2 * i)));
+        float angle = two_pi * uniform(uint32_t(2 * i + 1));
+        // Speed of a circular orbit under the force of particles.comp, jittered into ellipses
+        float speed = radius * std::sqrt(stiffness * (1.0f + radius * radius)) * (0.9f + 0.2f * uniform(uint32_t(i) ^ 0x9e3779b9u));
+
+        particles[i].position[0] = radius * std::cos(angle);
+        particles[i].position[1] = radius * std::sin(angle);
+        particles[i].velocity[0] = -speed * std::sin(angle);
+        particles[i].velocity[1] = speed * std::cos(angle);
+    }
+    return particles;
+}
+
+ParticleSystemCpu::ParticleSystemCpu(const std::vector<Particle> &particles)
+    : position_x(particles.size()), position_y(particles.size()), velocity_x(particles.size()), velocity_y(particles.size())
+{
+    for (size_t i = 0; i < particles.size(); i++) {
+        position_x[i] = particles[i].position[0];
+        position_y[i] = particles[i].position[1];
+        velocity_x[i] = particles[i].velocity[0];
+        velocity_y[i] = particles[i].velocity[1];
+    }
+}
+
+#ifdef PARTICLES_AVX
+// Same operations, in the same order, as particles.comp. Returns where the scalar tail starts.
+AVX_TARGET static size_t stepRangeAvx(float *px, float *py, float *vx, float *vy, size_t i, size_t end, float dt, float stiffness)
+{
+    const __m256 k = _mm256_set1_ps(-stiffness * dt);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 step = _mm256_set1_ps(dt);
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(px + i);
+        __m256 y = _mm256_loadu_ps(py + i);
+        __m256 r2 = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        __m256 s = _mm256_mul_ps(k, _mm256_add_ps(one, r2));
+        __m256 u = _mm256_add_ps(_mm256_loadu_ps(vx + i), _mm256_mul_ps(s, x));
+        __m256 v = _mm256_add_ps(_mm256_loadu_ps(vy + i), _mm256_mul_ps(s, y));
+        _mm256_storeu_ps(vx + i, u);
+        _mm256_storeu_ps(vy + i, v);
+        _mm256_storeu_ps(px + i, _mm256_add_ps(x, _mm256_mul_ps(u, step)));
+        _mm256_storeu_ps(py + i, _mm256_add_ps(y, _mm256_mul_ps(v, step)));
+    }
+    return i;
+}
+#endif
+
+void ParticleSystemCpu::stepRange(size_t begin, size_t end, float dt, float stiffness, bool use_simd)
+{
+    float *px = position_x.data();
+    float *py = position_y.data();
+    float *vx = velocity_x.data();
+    float *vy = velocity_y.data();
+    size_t i = begin;
+
+    // Same operations, in the same order, as particles.comp
+    if (use_simd) {
+#ifdef PARTICLES_AVX
+        static const bool avx = cpuSupportsAvx();
+        if (avx) {
+            i = stepRangeAvx(px, py, vx, vy, i, end, dt, stiffness);
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128 k = _mm_set1_ps(-stiffness * dt);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 step = _mm_set1_ps(dt);
+        for (; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(px + i);
+            __m128 y = _mm_loadu_ps(py + i);
+            __m128 r2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+            __m128 s = _mm_mul_ps(k, _mm_add_ps(one, r2));
+            __m128 u = _mm_add_ps(_mm_loadu_ps(vx + i), _mm_mul_ps(s, x));
+            __m128 v = _mm_add_ps(_mm_loadu_ps(vy + i), _mm_mul_ps(s, y));
+            _mm_storeu_ps(vx + i, u);
+            _mm_storeu_ps(vy + i, v);
+            _mm_storeu_ps(px + i, _mm_add_ps(x, _mm_mul_ps(u, step)));
+            _mm_storeu_ps(py + i, _mm_add_ps(y, _mm_mul_ps(v, step)));
+        }
+#endif
+    }
+
+    const float k = -stiffness * dt;
+    for (; i < end; i++) {
+        float s = k * (1.0f + (px[i] * px[i] + py[i] * py[i]));
+        vx[i] += s * px[i];
+        vy[i] += s * py[i];
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+    }
+}
+
+void ParticleSystemCpu::step(float dt, float stiffness, JobSystem &jobs, bool use_simd)
+{
+    // Ranges start on a multiple of the vector width so only the last one has a scalar tail
+    const size_t grain_size = 1024;
+    jobs.parallelFor(size(), grain_size, [&](size_t begin, size_t end) { stepRange(begin, end, dt, stiffness, use_simd); });
+}
+
+float ParticleSystemCpu::maxPositionDifference(const Particle *particles, size_t count) const
+{
+    float difference = 0.0f;
+    for (size_t i = 0; i < std::min(count, size()); i++) {
+        float dx = particles[i].position[0] - position_x[i];
+        float dy = particles[i].position[1] - position_y[i];
+        difference = std::max(difference, std::sqrt(dx * dx + dy * dy));
+    }
+    return difference;
+}
+
+void runParticleBenchmark(size_t count, unsigned int steps)
+{
+    auto settings = ParticleSettings();
+    auto particles = initialParticles(count, settings.stiffness);
+    unsigned int hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::cout << "Particle CPU reference: " << count << " particles, " << steps << " steps" << std::endl;
+
+    struct Configuration {
+        const char *name;
+        unsigned int threads;
+        bool use_simd;
+    };
+    const Configuration configurations[] = {
+        {"scalar, 1 thread", 1, false},
+        {"simd, 1 thread", 1, true},
+        {"scalar, all threads", hardware_threads, false},
+        {"simd, all threads", hardware_threads, true},
+    };
+
+    for (const auto &configuration : configurations) {
+        // Started before the timing, the workers persist across the steps
+        auto jobs = JobSystem(configuration.threads - 1);
+        auto system = ParticleSystemCpu(particles);
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < steps; i++) {
+            system.step(settings.dt, settings.stiffness, jobs, configuration.use_simd);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "  " << std::left << std::setw(22) << configuration.name << std::right << std::fixed
+                  << std::setprecision(1) << double(count) * steps / elapsed.count() / 1e6 << " Mparticles/s ("
+                  << std::setprecision(3) << elapsed.count() * 1000.0 / steps << " ms/step)" << std::defaultfloat
+                  << std::endl;
+    }
+}
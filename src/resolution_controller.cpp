@@ -0,0 +1,54 @@
+#include "resolution_controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(const DynamicResolutionSettings &settings) : settings(settings)
+{
+    this->settings.level_count = std::max(this->settings.level_count, 2u);
+    this->settings.min_scale = std::clamp(this->settings.min_scale, 0.1f, 1.0f);
+    current_level = this->settings.level_count - 1;
+}
+
+float ResolutionController::levelScale(unsigned int level) const
+{
+    float t = float(level) / float(settings.level_count - 1);
+    return settings.min_scale + (1.0f - settings.min_scale) * t;
+}
+
+void ResolutionController::setLevel(unsigned int level)
+{
+    if (level != current_level) {
+        current_level = level;
+        smoothed_time = 0.0;
+        skipped_frames = 0;
+    }
+    headroom_frames = 0;
+}
+
+void ResolutionController::update(double gpu_time)
+{
+    if (skipped_frames < settle_frames) {
+        skipped_frames++;
+        return;
+    }
+    smoothed_time = smoothed_time > 0.0 ? smoothed_time + smoothing * (gpu_time - smoothed_time) : gpu_time;
+
+    // GPU time is assumed proportional to the pixel count, the square of the scale
+    double budget = settings.frame_budget;
+    if (smoothed_time > high_threshold * budget && current_level > 0) {
+        double wanted_scale = scale() * std::sqrt(target * budget / smoothed_time);
+        unsigned int level = current_level - 1;
+        while (level > 0 && levelScale(level) > wanted_scale) {
+            level--;
+        }
+        setLevel(level);
+    } else if (smoothed_time < low_threshold * budget && current_level + 1 < settings.level_count) {
+        double ratio = levelScale(current_level + 1) / scale();
+        if (++headroom_frames >= raise_frames && smoothed_time * ratio * ratio < target * budget) {
+            setLevel(current_level + 1);
+        }
+    } else {
+        headroom_frames = 0;
+    }
+}
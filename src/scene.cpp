@@ -0,0 +1,373 @@
+#include "scene.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define SCENE_SSE 1
+#endif
+
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float uniform(uint32_t seed)
+{
+    return float(hash(seed) >> 8) / float(1u << 24);
+}
+
+uint32_t Scene::addNode(uint32_t parent, const float translation[3], float scale, const float spin_axis[3], float spin_speed,
+                        float bounds_radius)
+{
+    auto index = static_cast<uint32_t>(size());
+    uint32_t depth = parent == no_parent ? 0 : depths.at(parent) + 1;
+    if (index > 0 && depth < depths.back()) {
+        throw std::runtime_error("Scene nodes must be added level by level!");
+    }
+    if (index > 0 && depth > depths.back()) {
+        level_offsets.push_back(index);
+    }
+
+    // The SIMD loops work on groups of 4 nodes, pad with nodes that stay at rest
+    if (index % 4 == 0) {
+        for (auto *array : {&translation_x, &translation_y, &translation_z, &rotation_x, &rotation_y, &rotation_z, &scales,
+                            &spin_x, &spin_y, &spin_z, &local_radii, &world_center_x, &world_center_y, &world_center_z,
+                            &world_radii}) {
+            array->resize(index + 4, 0.0f);
+        }
+        rotation_w.resize(index + 4, 1.0f);
+        spin_w.resize(index + 4, 1.0f);
+        local_matrices.resize(index + 4, Matrix3x4{});
+        world_matrices.resize(index + 4, Matrix3x4{});
+    }
+
+    parents.push_back(parent);
+    depths.push_back(depth);
+    if (level_offsets.size() == 1) {
+        level_offsets.push_back(0);
+    }
+    level_offsets.back() = index + 1;
+
+    translation_x[index] = translation[0];
+    translation_y[index] = translation[1];
+    translation_z[index] = translation[2];
+    scales[index] = scale;
+    local_radii[index] = bounds_radius;
+
+    float half_angle = 0.5f * spin_speed * time_step;
+    float s = std::sin(half_angle);
+    spin_x[index] = spin_axis[0] * s;
+    spin_y[index] = spin_axis[1] * s;
+    spin_z[index] = spin_axis[2] * s;
+    spin_w[index] = std::cos(half_angle);
+    return index;
+}
+
+// Local matrices from the SoA transforms, after one spin step
+void Scene::animateRange(size_t begin, size_t end)
+{
+    size_t i = begin;
+
+#if SCENE_SSE
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 three = _mm_set1_ps(3.0f);
+    for (; i + 4 <= end; i += 4) {
+        __m128 qx = _mm_load_ps(&rotation_x[i]);
+        __m128 qy = _mm_load_ps(&rotation_y[i]);
+        __m128 qz = _mm_load_ps(&rotation_z[i]);
+        __m128 qw = _mm_load_ps(&rotation_w[i]);
+        __m128 sx = _mm_load_ps(&spin_x[i]);
+        __m128 sy = _mm_load_ps(&spin_y[i]);
+        __m128 sz = _mm_load_ps(&spin_z[i]);
+        __m128 sw = _mm_load_ps(&spin_w[i]);
+
+        // q = q * spin
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, sx), _mm_mul_ps(qx, sw)), _mm_sub_ps(_mm_mul_ps(qy, sz), _mm_mul_ps(qz, sy)));
+        __m128 y = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qw, sy), _mm_mul_ps(qx, sz)), _mm_add_ps(_mm_mul_ps(qy, sw), _mm_mul_ps(qz, sx)));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, sz), _mm_mul_ps(qx, sy)), _mm_sub_ps(_mm_mul_ps(qz, sw), _mm_mul_ps(qy, sx)));
+        __m128 w = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(qw, sw), _mm_mul_ps(qx, sx)), _mm_add_ps(_mm_mul_ps(qy, sy), _mm_mul_ps(qz, sz)));
+
+        // Renormalize against drift, rsqrt refined by one Newton-Raphson step
+        __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+        __m128 r = _mm_rsqrt_ps(length2);
+        r = _mm_mul_ps(_mm_mul_ps(half, r), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(length2, r), r)));
+        x = _mm_mul_ps(x, r);
+        y = _mm_mul_ps(y, r);
+        z = _mm_mul_ps(z, r);
+        w = _mm_mul_ps(w, r);
+        _mm_store_ps(&rotation_x[i], x);
+        _mm_store_ps(&rotation_y[i], y);
+        _mm_store_ps(&rotation_z[i], z);
+        _mm_store_ps(&rotation_w[i], w);
+
+        __m128 s = _mm_load_ps(&scales[i]);
+        __m128 s2 = _mm_mul_ps(two, s);
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        // Scaled rotation matrix and translation, one register per element for 4 nodes
+        __m128 m[3][4] = {
+            {_mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)))), _mm_mul_ps(s2, _mm_sub_ps(xy, wz)),
+             _mm_mul_ps(s2, _mm_add_ps(xz, wy)), _mm_load_ps(&translation_x[i])},
+            {_mm_mul_ps(s2, _mm_add_ps(xy, wz)), _mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)))),
+             _mm_mul_ps(s2, _mm_sub_ps(yz, wx)), _mm_load_ps(&translation_y[i])},
+            {_mm_mul_ps(s2, _mm_sub_ps(xz, wy)), _mm_mul_ps(s2, _mm_add_ps(yz, wx)),
+             _mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)))), _mm_load_ps(&translation_z[i])},
+        };
+        // Transpose to one row per node
+        for (int row = 0; row < 3; row++) {
+            _MM_TRANSPOSE4_PS(m[row][0], m[row][1], m[row][2], m[row][3]);
+            for (int node = 0; node < 4; node++) {
+                _mm_store_ps(local_matrices[i + node].rows[row], m[row][node]);
+            }
+        }
+    }
+#endif
+
+    for (; i < end; i++) {
+        float qx = rotation_x[i], qy = rotation_y[i], qz = rotation_z[i], qw = rotation_w[i];
+        float sx = spin_x[i], sy = spin_y[i], sz = spin_z[i], sw = spin_w[i];
+        float x = qw * sx + qx * sw + (qy * sz - qz * sy);
+        float y = qw * sy - qx * sz + (qy * sw + qz * sx);
+        float z = qw * sz + qx * sy + (qz * sw - qy * sx);
+        float w = qw * sw - qx * sx - (qy * sy + qz * sz);
+        float r = 1.0f / std::sqrt(x * x + y * y + z * z + w * w);
+        rotation_x[i] = x *= r;
+        rotation_y[i] = y *= r;
+        rotation_z[i] = z *= r;
+        rotation_w[i] = w *= r;
+
+        float s = scales[i];
+        float (*m)[4] = local_matrices[i].rows;
+        m[0][0] = s * (1.0f - 2.0f * (y * y + z * z));
+        m[0][1] = 2.0f * s * (x * y - w * z);
+        m[0][2] = 2.0f * s * (x * z + w * y);
+        m[0][3] = translation_x[i];
+        m[1][0] = 2.0f * s * (x * y + w * z);
+        m[1][1] = s * (1.0f - 2.0f * (x * x + z * z));
+        m[1][2] = 2.0f * s * (y * z - w * x);
+        m[1][3] = translation_y[i];
+        m[2][0] = 2.0f * s * (x * z - w * y);
+        m[2][1] = 2.0f * s * (y * z + w * x);
+        m[2][2] = s * (1.0f - 2.0f * (x * x + y * y));
+        m[2][3] = translation_z[i];
+    }
+}
+
+// World matrices and bounds of nodes whose parents are already done
+void Scene::transformRange(size_t begin, size_t end, InstanceData *instances)
+{
+    for (size_t i = begin; i < end; i++) {
+        const Matrix3x4 &local = local_matrices[i];
+        Matrix3x4 &world = world_matrices[i];
+        uint32_t parent = parents[i];
+
+#if SCENE_SSE
+        __m128 l0 = _mm_load_ps(local.rows[0]);
+        __m128 l1 = _mm_load_ps(local.rows[1]);
+        __m128 l2 = _mm_load_ps(local.rows[2]);
+        __m128 w[3] = {l0, l1, l2};
+        if (parent != no_parent) {
+            // world row = p[0] * local row 0 + p[1] * local row 1 + p[2] * local row 2 + (0, 0, 0, p[3])
+            const __m128 w_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+            for (int row = 0; row < 3; row++) {
+                __m128 p = _mm_load_ps(world_matrices[parent].rows[row]);
+                __m128 r = _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)), l0);
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)), l1));
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)), l2));
+                w[row] = _mm_add_ps(r, _mm_and_ps(p, w_mask));
+            }
+        }
+        for (int row = 0; row < 3; row++) {
+            _mm_store_ps(world.rows[row], w[row]);
+            // The instance buffer is usually write-combined memory that is never read back
+            _mm_stream_ps(instances[i].rows[row], w[row]);
+        }
+        // Squared lengths of the basis vectors in the first three lanes
+        __m128 lengths2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], w[0]), _mm_mul_ps(w[1], w[1])), _mm_mul_ps(w[2], w[2]));
+        __m128 max_scale2 = _mm_max_ss(_mm_max_ss(lengths2, _mm_shuffle_ps(lengths2, lengths2, _MM_SHUFFLE(1, 1, 1, 1))),
+                                       _mm_shuffle_ps(lengths2, lengths2, _MM_SHUFFLE(2, 2, 2, 2)));
+        float max_scale = _mm_cvtss_f32(_mm_sqrt_ss(max_scale2));
+#else
+        if (parent == no_parent) {
+            world = local;
+        } else {
+            const Matrix3x4 &p = world_matrices[parent];
+            for (int row = 0; row < 3; row++) {
+                for (int column = 0; column < 4; column++) {
+                    world.rows[row][column] = p.rows[row][0] * local.rows[0][column] + p.rows[row][1] * local.rows[1][column] +
+                                              p.rows[row][2] * local.rows[2][column] + (column == 3 ? p.rows[row][3] : 0.0f);
+                }
+            }
+        }
+        std::copy(&world.rows[0][0], &world.rows[0][0] + 12, &instances[i].rows[0][0]);
+        float max_scale2 = 0.0f;
+        for (int column = 0; column < 3; column++) {
+            float length2 = world.rows[0][column] * world.rows[0][column] + world.rows[1][column] * world.rows[1][column] +
+                            world.rows[2][column] * world.rows[2][column];
+            max_scale2 = std::max(max_scale2, length2);
+        }
+        float max_scale = std::sqrt(max_scale2);
+#endif
+        world_center_x[i] = world.rows[0][3];
+        world_center_y[i] = world.rows[1][3];
+        world_center_z[i] = world.rows[2][3];
+        world_radii[i] = local_radii[i] * max_scale;
+    }
+#if SCENE_SSE
+    // Make the streaming stores visible before the job is reported done
+    _mm_sfence();
+#endif
+}
+
+void Scene::update(JobSystem &jobs, InstanceData *instances)
+{
+    if (reinterpret_cast<uintptr_t>(instances) % 16 != 0) {
+        throw std::runtime_error("Instance data must be 16-byte aligned!");
+    }
+    // Ranges stay on multiples of 4 nodes for the SIMD loops, the padding is animated along
+    const size_t grain_size = 256;
+    jobs.parallelFor(local_matrices.size(), grain_size, [this](size_t begin, size_t end) { animateRange(begin, end); });
+
+    for (size_t level = 0; level < levelCount(); level++) {
+        size_t offset = level_offsets[level];
+        jobs.parallelFor(level_offsets[level + 1] - offset, grain_size, [this, offset, instances](size_t begin, size_t end) {
+            transformRange(offset + begin, offset + end, instances);
+        });
+    }
+}
+
+SceneBounds Scene::bounds() const
+{
+    if (size() == 0) {
+        return {{0.0f, 0.0f, 0.0f}, 0.0f};
+    }
+    float lower[3] = {INFINITY, INFINITY, INFINITY};
+    float upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = 0; i < size(); i++) {
+        const float center[3] = {world_center_x[i], world_center_y[i], world_center_z[i]};
+        for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::min(lower[axis], center[axis] - world_radii[i]);
+            upper[axis] = std::max(upper[axis], center[axis] + world_radii[i]);
+        }
+    }
+
+    SceneBounds bounds = {};
+    for (int axis = 0; axis < 3; axis++) {
+        bounds.center[axis] = 0.5f * (lower[axis] + upper[axis]);
+    }
+    for (size_t i = 0; i < size(); i++) {
+        float dx = world_center_x[i] - bounds.center[0];
+        float dy = world_center_y[i] - bounds.center[1];
+        float dz = world_center_z[i] - bounds.center[2];
+        bounds.radius = std::max(bounds.radius, std::sqrt(dx * dx + dy * dy + dz * dz) + world_radii[i]);
+    }
+    return bounds;
+}
+
+Scene createDemoScene(size_t node_count, float mesh_radius)
+{
+    const float two_pi = 6.2831853f;
+    const size_t cluster_size = 1 + 7 + 7 * 8;
+    size_t cluster_count = (node_count + cluster_size - 1) / cluster_size;
+    auto grid_size = static_cast<size_t>(std::ceil(std::sqrt(double(cluster_count))));
+    const float spacing = 10.0f;
+
+    auto scene = Scene();
+    uint32_t seed = 0;
+    auto randomAxis = [&seed, two_pi](float axis[3]) {
+        float z = 2.0f * uniform(seed++) - 1.0f;
+        float angle = two_pi * uniform(seed++);
+        float r = std::sqrt(1.0f - z * z);
+        axis[0] = r * std::cos(angle);
+        axis[1] = r * std::sin(angle);
+        axis[2] = z;
+    };
+
+    const float up[3] = {0.0f, 1.0f, 0.0f};
+    for (size_t i = 0; i < cluster_count; i++) {
+        float translation[3] = {(float(i % grid_size) - 0.5f * float(grid_size - 1)) * spacing, 0.0f,
+                                (float(i / grid_size) - 0.5f * float(grid_size - 1)) * spacing};
+        scene.addNode(Scene::no_parent, translation, 1.0f, up, 0.2f + 0.3f * uniform(seed++), mesh_radius);
+    }
+
+    // Each level orbits the one above it, filled breadth first up to node_count
+    struct Level {
+        unsigned int children;
+        float orbit;
+        float scale;
+    };
+    const Level levels[] = {{7, 4.0f, 0.4f}, {8, 3.0f, 0.35f}};
+    size_t parent_begin = 0;
+    size_t parent_end = scene.size();
+    for (const auto &level : levels) {
+        for (size_t parent = parent_begin; parent < parent_end && scene.size() < node_count; parent++) {
+            for (unsigned int k = 0; k < level.children && scene.size() < node_count; k++) {
+                float angle = two_pi * float(k) / float(level.children);
+                float translation[3] = {level.orbit * std::cos(angle), 0.5f * (uniform(seed++) - 0.5f) * level.orbit,
+                                        level.orbit * std::sin(angle)};
+                float axis[3];
+                randomAxis(axis);
+                scene.addNode(static_cast<uint32_t>(parent), translation, level.scale, axis, 0.5f + 1.5f * uniform(seed++),
+                              mesh_radius);
+            }
+        }
+        parent_begin = parent_end;
+        parent_end = scene.size();
+    }
+    return scene;
+}
+
+void runSceneBenchmark(size_t node_count, unsigned int updates)
+{
+    auto instances = std::vector<InstanceData, AlignedAllocator<InstanceData, 16>>(node_count);
+    unsigned int hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    auto thread_counts = std::vector<unsigned int>();
+    for (unsigned int threads = 1; threads < hardware_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(hardware_threads);
+
+    auto reference = createDemoScene(node_count, 1.0f);
+    std::cout << "Scene update: " << reference.size() << " nodes in " << reference.levelCount() << " levels, " << updates
+              << " updates" << std::endl;
+
+    double single_thread_time = 0.0;
+    for (unsigned int threads : thread_counts) {
+        auto jobs = JobSystem(threads - 1);
+        auto scene = reference;
+        scene.update(jobs, instances.data());
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < updates; i++) {
+            scene.update(jobs, instances.data());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double time = elapsed.count() / updates;
+        if (threads == 1) {
+            single_thread_time = time;
+        }
+
+        std::cout << "  " << std::setw(3) << threads << (threads == 1 ? " thread:  " : " threads: ") << std::fixed
+                  << std::setprecision(3) << time * 1000.0 << " ms/update, " << std::setprecision(1)
+                  << double(scene.size()) / time / 1e6 << " Mnodes/s, x" << std::setprecision(2)
+                  << single_thread_time / time << std::defaultfloat << std::endl;
+    }
+}